@@ -1,7 +1,12 @@
+#include <algorithm>
 #include <thread>
+#include <tuple>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include "Blueprint.h"
+#include "Compression.h"
+#include "BlueprintBinary.h"
 
 void Blueprint::PopulateNodes(const std::vector<Node*>& src)
 {
@@ -138,10 +143,131 @@ Blueprint::Blueprint(const std::vector<Node*>& src)
     wireThread.join();
 }
 
+bool Blueprint::IsLoaded() const
+{
+    return bodyFilename.empty();
+}
+
+void Blueprint::LoadBody()
+{
+    if (IsLoaded())
+        return;
+    Blueprint body;
+    try
+    {
+        LoadBlueprint(bodyFilename.c_str(), body);
+    }
+    catch (std::length_error e)
+    {
+        body = Blueprint(); // Corrupt; left empty rather than retried every frame
+    }
+    nodes = std::move(body.nodes);
+    wires = std::move(body.wires);
+    if (body.contentHash)
+        contentHash = body.contentHash;
+    bodyFilename.clear();
+}
+
+void Blueprint::Canonicalize(std::vector<NodeBP>& canonicalNodes, std::vector<WireBP>& canonicalWires) const
+{
+    IVec2 min = nodes.empty() ? IVec2::Zero() : nodes[0].relativePosition;
+    for (const NodeBP& node : nodes)
+    {
+        min.x = std::min(min.x, node.relativePosition.x);
+        min.y = std::min(min.y, node.relativePosition.y);
+    }
+
+    auto nodeKey = [](const NodeBP& node)
+    {
+        return std::tie(node.relativePosition.y, node.relativePosition.x, node.gate, node.extraParam, node.b_io, node.name);
+    };
+    std::vector<size_t> order(nodes.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return nodeKey(nodes[a]) < nodeKey(nodes[b]); });
+
+    std::vector<size_t> remap(nodes.size());
+    canonicalNodes.clear();
+    canonicalNodes.reserve(nodes.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        remap[order[i]] = i;
+        NodeBP& node = canonicalNodes.emplace_back(nodes[order[i]]);
+        node.relativePosition -= min;
+    }
+
+    canonicalWires.clear();
+    canonicalWires.reserve(wires.size());
+    for (const WireBP& wire : wires)
+    {
+        canonicalWires.emplace_back(remap[wire.startNodeIndex], remap[wire.endNodeIndex], wire.elbowConfig);
+    }
+    auto wireKey = [](const WireBP& wire) { return std::tie(wire.startNodeIndex, wire.endNodeIndex, wire.elbowConfig); };
+    std::sort(canonicalWires.begin(), canonicalWires.end(), [&](const WireBP& a, const WireBP& b) { return wireKey(a) < wireKey(b); });
+}
+
+uint64_t Blueprint::ComputeContentHash() const
+{
+    std::vector<NodeBP> canonicalNodes;
+    std::vector<WireBP> canonicalWires;
+    Canonicalize(canonicalNodes, canonicalWires);
+
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void* data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ ((const uint8_t*)data)[i]) * 1099511628211ull;
+        }
+    };
+    for (const NodeBP& node : canonicalNodes)
+    {
+        int32_t fields[] = { node.b_io, (int32_t)node.gate, node.extraParam, node.relativePosition.x, node.relativePosition.y, (int32_t)node.name.size() };
+        add(fields, sizeof(fields));
+        add(node.name.data(), node.name.size());
+    }
+    for (const WireBP& wire : canonicalWires)
+    {
+        uint64_t fields[] = { wire.startNodeIndex, wire.endNodeIndex, (uint64_t)wire.elbowConfig };
+        add(fields, sizeof(fields));
+    }
+    return hash;
+}
+
+bool Blueprint::IsSameBody(const Blueprint& other) const
+{
+    if (nodes.size() != other.nodes.size() || wires.size() != other.wires.size())
+        return false;
+    std::vector<NodeBP> nodesA, nodesB;
+    std::vector<WireBP> wiresA, wiresB;
+    Canonicalize(nodesA, wiresA);
+    other.Canonicalize(nodesB, wiresB);
+    for (size_t i = 0; i < nodesA.size(); ++i)
+    {
+        const NodeBP& a = nodesA[i];
+        const NodeBP& b = nodesB[i];
+        if (a.b_io != b.b_io || a.gate != b.gate || a.extraParam != b.extraParam || a.relativePosition != b.relativePosition || a.name != b.name)
+            return false;
+    }
+    for (size_t i = 0; i < wiresA.size(); ++i)
+    {
+        const WireBP& a = wiresA[i];
+        const WireBP& b = wiresB[i];
+        if (a.startNodeIndex != b.startNodeIndex || a.endNodeIndex != b.endNodeIndex || a.elbowConfig != b.elbowConfig)
+            return false;
+    }
+    return true;
+}
+
 void Blueprint::DrawSelectionPreview(float zoom, IVec2 pos, Color backgroundColor, Color nodeColor, Color ioNodeColor, Color wireColor, uint8_t lod) const
 {
     IVec2 offset = pos + IVec2(g_gridSize);
     DrawRectangleIRect(GetSelectionPreviewRect(pos), backgroundColor);
+    if (!IsLoaded())
+        return; // Just the footprint until something asks for the body
 
     // Wires
     switch (lod)
@@ -216,39 +342,58 @@ IRect Blueprint::GetSelectionPreviewRect(IVec2 pos) const
     return IRect(pos, extents + IVec2(g_gridSize * 2));
 }
 
-void Blueprint::Save() const
+void Blueprint::Save(bool compress) const
 {
-    std::ofstream file(TextFormat(".\\blueprints\\%s.bp", name.c_str()));
-    file << "n " << nodes.size() << '\n';
-    for (const NodeBP& node : nodes)
-    {
-        file << node.b_io << ' ' << (char)node.gate << ' ' << (unsigned)node.extraParam << ' '
-            << node.relativePosition.x << ' ' << node.relativePosition.y;
-        if (!node.name.empty())
-            file << ' ' << node.name;
-        file << '\n';
-    }
-    file << "w " << wires.size() << '\n';
-    for (const WireBP& wire : wires)
+    std::string data;
+    bpb::Write(*this, data);
+
+    if (compress)
     {
-        file << wire.startNodeIndex << ' ' << wire.endNodeIndex << ' ' << (int)wire.elbowConfig << '\n';
+        std::string packed;
+        compression::Compress(data, packed);
+        data = std::move(packed);
     }
-    file.close();
+    std::ofstream(TextFormat(".\\blueprints\\%s.bpb", name.c_str()), std::fstream::out | std::fstream::binary).write(data.data(), data.size());
 }
 
+static void ReadBlueprint(std::istream& file, Blueprint& dest);
+
 void LoadBlueprint(const char* filename, Blueprint& dest)
 {
     dest = Blueprint(); // Reset in case of edge cases
-    std::ifstream file(TextFormat("%s", filename));
+    std::ifstream file(filename, std::fstream::in | std::fstream::binary);
     if (file.bad())
         return;
     std::string name = filename;
     size_t start = name.find_last_of('\\') + 1;
-    size_t end = name.size() - 3;
-    if (start != name.npos)
-        dest.name = name.substr(start, end - start);
+    size_t end = name.find_last_of('.');
+    if (end == name.npos || end < start)
+        end = name.size();
+    dest.name = name.substr(start, end - start);
+
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    std::string unpacked;
+    std::string_view contents;
+    uint8_t filter;
+    if (!compression::Unpack(data, unpacked, contents, filter))
+        throw std::length_error("Blueprint file corrupt");
+
+    if (bpb::IsBinaryFilename(filename))
+    {
+        if (!bpb::Read(contents, dest))
+            throw std::length_error("Blueprint file corrupt");
+    }
     else
-        dest.name = name;
+    {
+        // Parsed from the buffer already read; contents points into one of these two
+        std::istringstream stream(compression::IsCompressed(data) ? std::move(unpacked) : std::move(data));
+        ReadBlueprint(stream, dest);
+    }
+}
+
+static void ReadBlueprint(std::istream& file, Blueprint& dest)
+{
     IVec2 extents = IVec2::Zero();
 
     file.ignore(64, 'n');
@@ -267,6 +412,8 @@ void LoadBlueprint(const char* filename, Blueprint& dest)
         {
             file.ignore(1);
             std::getline(file, name);
+            if (!name.empty() && name.back() == '\r') // Read in binary, so CRLF files keep their '\r'
+                name.pop_back();
             dest.nodes.emplace_back(name, io, (Gate)gate, ep, pos);
         }
         else
@@ -288,5 +435,4 @@ void LoadBlueprint(const char* filename, Blueprint& dest)
         _ASSERT_EXPR(elbowConfig < 4, L"Elbow config out of range");
         dest.wires.emplace_back(startNodeIndex, endNodeIndex, (ElbowConfig)elbowConfig);
     }
-    file.close();
 }
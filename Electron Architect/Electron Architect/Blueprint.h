@@ -62,11 +62,26 @@ public:
     IVec2 extents;
     std::vector<NodeBP> nodes;
     std::vector<WireBP> wires;
+    std::string bodyFilename; // Set while nodes and wires are still on disk; see LoadBody
+    uint64_t contentHash = 0; // ComputeContentHash, if it's known; 0 otherwise
+
+    // Only the body (nodes and wires) is deferred; name and extents are always valid
+    bool IsLoaded() const;
+    // Parses the body from bodyFilename if it hasn't been yet
+    void LoadBody();
+
+    // The body with positions relative to its top-left and nodes and wires sorted,
+    // so circuits that only differ in the order they were captured come out the same
+    void Canonicalize(std::vector<NodeBP>& canonicalNodes, std::vector<WireBP>& canonicalWires) const;
+    // Hash of the canonical body, for finding identical blueprints without comparing them
+    uint64_t ComputeContentHash() const;
+    bool IsSameBody(const Blueprint& other) const;
 
     void DrawSelectionPreview(float zoom, IVec2 pos, Color backgroundColor, Color nodeColor, Color ioNodeColor, Color wireColor, uint8_t lod) const;
     IRect GetSelectionPreviewRect(IVec2 pos) const;
 
-    void Save() const;
+    void Save(bool compress = false) const;
 };
 
+// Reads a text .bp or binary .bpb, compressed or not. Throws std::length_error if the file is corrupt.
 void LoadBlueprint(const char* filename, Blueprint& dest);
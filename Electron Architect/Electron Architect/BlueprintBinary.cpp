@@ -0,0 +1,102 @@
+#include <cstring>
+#include "Blueprint.h"
+#include "BlueprintBinary.h"
+
+namespace bpb
+{
+    bool IsBinaryFilename(const std::string& filename)
+    {
+        return filename.ends_with(".bpb");
+    }
+
+    void Write(const Blueprint& bp, std::string& out)
+    {
+        std::vector<NodeBP> nodes;
+        std::vector<WireBP> wires;
+        bp.Canonicalize(nodes, wires);
+
+        Header header = {};
+        memcpy(header.magic, g_magic, sizeof(g_magic));
+        header.version = g_version;
+        header.nodeCount = (uint32_t)nodes.size();
+        header.wireCount = (uint32_t)wires.size();
+        header.extentsX = bp.extents.x;
+        header.extentsY = bp.extents.y;
+        header.contentHash = bp.ComputeContentHash();
+
+        std::string strings;
+        std::vector<NodeRecord> nodeRecords(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            NodeRecord& record = nodeRecords[i];
+            record = {};
+            record.x = nodes[i].relativePosition.x;
+            record.y = nodes[i].relativePosition.y;
+            record.gate = (uint8_t)nodes[i].gate;
+            record.extraParam = nodes[i].extraParam;
+            record.io = nodes[i].b_io;
+            record.nameOffset = (uint32_t)strings.size();
+            record.nameLength = (uint32_t)nodes[i].name.size();
+            strings += nodes[i].name;
+        }
+        std::vector<WireRecord> wireRecords(wires.size());
+        for (size_t i = 0; i < wires.size(); ++i)
+        {
+            WireRecord& record = wireRecords[i];
+            record = {};
+            record.start = (uint32_t)wires[i].startNodeIndex;
+            record.end = (uint32_t)wires[i].endNodeIndex;
+            record.elbowConfig = (uint8_t)wires[i].elbowConfig;
+        }
+        header.stringSize = strings.size();
+
+        out.append((const char*)&header, sizeof(header));
+        out.append((const char*)nodeRecords.data(), nodeRecords.size() * sizeof(NodeRecord));
+        out.append((const char*)wireRecords.data(), wireRecords.size() * sizeof(WireRecord));
+        out += strings;
+    }
+
+    bool Read(std::string_view data, Blueprint& bp)
+    {
+        Header header;
+        if (data.size() < sizeof(header))
+            return false;
+        memcpy(&header, data.data(), sizeof(header));
+        if (memcmp(header.magic, g_magic, sizeof(g_magic)) != 0 || header.version != g_version)
+            return false;
+
+        const uint64_t nodeBytes = (uint64_t)header.nodeCount * sizeof(NodeRecord);
+        const uint64_t wireBytes = (uint64_t)header.wireCount * sizeof(WireRecord);
+        if (nodeBytes + wireBytes + header.stringSize != data.size() - sizeof(header))
+            return false;
+        const char* nodeData = data.data() + sizeof(header);
+        const char* wireData = nodeData + nodeBytes;
+        const std::string_view strings(wireData + wireBytes, (size_t)header.stringSize);
+
+        bp.nodes.clear();
+        bp.nodes.reserve(header.nodeCount);
+        for (uint32_t i = 0; i < header.nodeCount; ++i)
+        {
+            NodeRecord record;
+            memcpy(&record, nodeData + i * sizeof(NodeRecord), sizeof(record));
+            if (record.nameOffset > strings.size() || record.nameLength > strings.size() - record.nameOffset)
+                return false;
+            bp.nodes.emplace_back(
+                std::string(strings.substr(record.nameOffset, record.nameLength)),
+                !!record.io, (Gate)record.gate, record.extraParam, IVec2(record.x, record.y));
+        }
+        bp.wires.clear();
+        bp.wires.reserve(header.wireCount);
+        for (uint32_t i = 0; i < header.wireCount; ++i)
+        {
+            WireRecord record;
+            memcpy(&record, wireData + i * sizeof(WireRecord), sizeof(record));
+            if (record.start >= header.nodeCount || record.end >= header.nodeCount || record.elbowConfig >= 4)
+                return false;
+            bp.wires.emplace_back(record.start, record.end, (ElbowConfig)record.elbowConfig);
+        }
+        bp.extents = IVec2(header.extentsX, header.extentsY);
+        bp.contentHash = header.contentHash;
+        return true;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+struct Blueprint;
+
+// Binary blueprint format (.bpb).
+// A header, then fixed-size node and wire records, then a string table holding node names. Little-endian.
+// Bodies are written in canonical order (see Blueprint::ComputeContentHash), so identical circuits give identical files.
+namespace bpb
+{
+    constexpr char g_magic[4] = { 'B', 'P', 'B', '\0' };
+    constexpr uint32_t g_version = 1;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t nodeCount;
+        uint32_t wireCount;
+        int32_t extentsX;
+        int32_t extentsY;
+        uint64_t contentHash;
+        uint64_t stringSize;
+    };
+
+    struct NodeRecord
+    {
+        int32_t x;
+        int32_t y;
+        uint8_t gate;
+        uint8_t extraParam;
+        uint8_t io;
+        uint8_t reserved;
+        uint32_t nameOffset; // Into the string table
+        uint32_t nameLength;
+    };
+
+    struct WireRecord
+    {
+        uint32_t start; // Index into the node records
+        uint32_t end;
+        uint8_t elbowConfig;
+        uint8_t reserved[3];
+    };
+
+    static_assert(sizeof(Header) == 40 && sizeof(NodeRecord) == 20 && sizeof(WireRecord) == 12,
+        "Record layout is part of the file format");
+
+    bool IsBinaryFilename(const std::string& filename);
+
+    // Appends bp's body in canonical order
+    void Write(const Blueprint& bp, std::string& out);
+    // Fills in bp's body and extents, leaving its name alone. Returns false if data isn't a .bpb this version can read, or is damaged.
+    bool Read(std::string_view data, Blueprint& bp);
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include "BlueprintLibrary.h"
+#include "NativeBlueprints.h"
+
+namespace fs = std::filesystem;
+
+// Everything the library knows about a blueprint without parsing it
+struct IndexEntry
+{
+    std::string filename; // Relative to the directory; the blueprint's name is its stem
+    int64_t writeTime = 0;
+    uint64_t fileSize = 0;
+    IVec2 extents = IVec2::Zero();
+    size_t nodeCount = 0;
+    size_t wireCount = 0;
+    size_t ioCount = 0;
+    uint64_t contentHash = 0; // Key for cached thumbnails
+};
+
+constexpr int g_indexVersion = 2;
+
+static std::unordered_map<std::string, IndexEntry> ReadIndex(const fs::path& path)
+{
+    std::unordered_map<std::string, IndexEntry> entries;
+    std::ifstream file(path);
+    std::string line;
+    int version = 0;
+    if (!std::getline(file, line) || !(std::istringstream(line) >> line >> version) || version != g_indexVersion)
+        return entries; // Missing or from another version; everything gets re-indexed
+
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        IndexEntry entry;
+        if (!(fields >> entry.writeTime >> entry.fileSize >> entry.extents.x >> entry.extents.y
+            >> entry.nodeCount >> entry.wireCount >> entry.ioCount >> std::hex >> entry.contentHash))
+            continue;
+        fields.ignore(1);
+        std::getline(fields, entry.filename);
+        entries.emplace(entry.filename, entry);
+    }
+    return entries;
+}
+
+static void WriteIndex(const fs::path& path, const std::vector<IndexEntry>& entries)
+{
+    std::ostringstream text;
+    text << "bpi " << g_indexVersion << '\n';
+    for (const IndexEntry& entry : entries)
+    {
+        text << entry.writeTime << ' ' << entry.fileSize << ' ' << entry.extents.x << ' ' << entry.extents.y << ' '
+            << entry.nodeCount << ' ' << entry.wireCount << ' ' << entry.ioCount << ' '
+            << std::hex << entry.contentHash << std::dec << ' ' << entry.filename << '\n';
+    }
+    std::ofstream(path) << text.str();
+}
+
+BlueprintLibraryScan ScanBlueprintLibrary(const std::string& directory, BlueprintScanProgress* progress)
+{
+    BlueprintLibraryScan scan;
+    const fs::path indexPath = fs::path(directory) / g_blueprintIndexFilename;
+    const std::unordered_map<std::string, IndexEntry> indexed = ReadIndex(indexPath);
+
+    std::error_code error;
+    std::vector<fs::path> files;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+    {
+        if (entry.is_regular_file(error) && (entry.path().extension() == ".bp" || entry.path().extension() == ".bpb"))
+            files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<IndexEntry> entries(files.size());
+    std::vector<size_t> stale; // Files the index doesn't cover, by position in files
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        IndexEntry& current = entries[i];
+        current.filename = files[i].filename().string();
+        current.writeTime = (int64_t)fs::last_write_time(files[i], error).time_since_epoch().count();
+        current.fileSize = (uint64_t)fs::file_size(files[i], error);
+
+        auto it = indexed.find(current.filename);
+        if (it != indexed.end() && it->second.writeTime == current.writeTime && it->second.fileSize == current.fileSize)
+            current = it->second;
+        else
+            stale.push_back(i);
+    }
+
+    // Files vary a lot in size, so threads take the next file as they finish instead of splitting the list up front
+    std::vector<Blueprint> parsed(stale.size());
+    std::vector<char> corrupt(stale.size(), false);
+    if (progress)
+        progress->total = stale.size();
+    std::atomic<size_t> next = 0;
+    ParallelPieces(ParallelPieceCount(stale.size(), 8), [&](size_t)
+    {
+        for (size_t i = next++; i < stale.size(); i = next++)
+        {
+            try
+            {
+                LoadBlueprint(files[stale[i]].string().c_str(), parsed[i]);
+            }
+            catch (std::length_error e)
+            {
+                corrupt[i] = true;
+            }
+
+            const Blueprint& bp = parsed[i];
+            IndexEntry& current = entries[stale[i]];
+            current.extents = bp.extents;
+            current.nodeCount = bp.nodes.size();
+            current.wireCount = bp.wires.size();
+            current.ioCount = std::count_if(bp.nodes.begin(), bp.nodes.end(), [](const NodeBP& node_bp) { return node_bp.b_io; });
+            current.contentHash = parsed[i].contentHash = bp.ComputeContentHash();
+            if (progress)
+                ++progress->parsed;
+        }
+    });
+
+    // Merged back in filename order, so the library comes out the same however the threads were scheduled
+    std::vector<IndexEntry> kept;
+    kept.reserve(files.size());
+    scan.blueprints.reserve(files.size());
+    for (size_t i = 0, s = 0; i < files.size(); ++i)
+    {
+        if (s < stale.size() && stale[s] == i)
+        {
+            if (corrupt[s])
+                scan.corrupt.push_back(files[i].string());
+            else
+            {
+                scan.blueprints.push_back(std::move(parsed[s]));
+                kept.push_back(entries[i]);
+            }
+            ++s;
+            continue;
+        }
+        Blueprint& bp = scan.blueprints.emplace_back();
+        bp.name = files[i].stem().string();
+        bp.extents = entries[i].extents;
+        bp.bodyFilename = files[i].string();
+        bp.contentHash = entries[i].contentHash;
+        kept.push_back(entries[i]);
+    }
+    scan.reindexed = stale.size() - scan.corrupt.size();
+
+    if (!stale.empty() || kept.size() != indexed.size())
+        WriteIndex(indexPath, kept);
+    return scan;
+}
+
+BlueprintLibrary::BlueprintLibrary()
+{
+    table.reserve(_countof(nativeBlueprints));
+    for (const Blueprint& bp : nativeBlueprints)
+    {
+        _AddName(bp.name);
+        table.push_back(std::make_shared<Blueprint>(bp));
+        table.back()->contentHash = bp.ComputeContentHash();
+        byContent.emplace(table.back()->contentHash, table.back().get());
+    }
+}
+
+void BlueprintLibrary::_AddName(const std::string& name)
+{
+    names.insert(name);
+
+    // "Base (N)" counts towards the next number handed out for Base
+    if (name.size() < 4 || name.back() != ')')
+        return;
+    size_t open = name.rfind(" (");
+    if (open == name.npos || open + 3 >= name.size())
+        return;
+    for (size_t i = open + 2; i + 1 < name.size(); ++i)
+    {
+        if (name[i] < '0' || name[i] > '9')
+            return;
+    }
+    ++numbered[name.substr(0, open)];
+}
+
+const BlueprintLibrary::Table& BlueprintLibrary::GetBlueprints() const
+{
+    return table;
+}
+
+Blueprint* BlueprintLibrary::FindIdentical(const Blueprint& bp)
+{
+    auto [begin, end] = byContent.equal_range(bp.contentHash ? bp.contentHash : bp.ComputeContentHash());
+    for (auto it = begin; it != end; ++it)
+    {
+        Blueprint* candidate = it->second;
+        candidate->LoadBody(); // Hashes can collide, so bodies still get compared
+        if (candidate->IsSameBody(bp))
+            return candidate;
+    }
+    return nullptr;
+}
+
+Blueprint* BlueprintLibrary::Store(const Blueprint& bp)
+{
+    return Store(Blueprint(bp));
+}
+
+Blueprint* BlueprintLibrary::Store(Blueprint&& bp)
+{
+    auto copy = std::make_shared<Blueprint>(std::move(bp));
+
+    // Ensure unique name
+    if (names.contains(copy->name))
+    {
+        const std::string base = copy->name;
+        size_t number = 1 + numbered[base];
+        do
+        {
+            copy->name = base + " (" + std::to_string(number++) + ")";
+        } while (names.contains(copy->name));
+    }
+    _AddName(copy->name);
+    if (copy->IsLoaded() && !copy->contentHash)
+        copy->contentHash = copy->ComputeContentHash();
+    if (copy->contentHash)
+        byContent.emplace(copy->contentHash, copy.get());
+
+    table.push_back(copy);
+    return copy.get();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Blueprint.h"
+
+// The blueprints directory keeps an index of every .bp's header beside them, so startup reads one small file
+// instead of parsing every body. Files that are new or changed since the index was written are parsed and re-indexed.
+constexpr const char* g_blueprintIndexFilename = "library.bpi";
+
+struct BlueprintLibraryScan
+{
+    std::vector<Blueprint> blueprints; // In filename order; bodies are left on disk unless indexing had to parse them
+    size_t reindexed = 0; // Files the index didn't cover
+    std::vector<std::string> corrupt;
+};
+
+// Counts up as files are parsed; safe to read from another thread while the scan runs
+struct BlueprintScanProgress
+{
+    std::atomic<size_t> parsed = 0;
+    std::atomic<size_t> total = 0;
+};
+
+// Parses stale files in parallel and rewrites the index if it didn't match the directory
+BlueprintLibraryScan ScanBlueprintLibrary(const std::string& directory, BlueprintScanProgress* progress = nullptr);
+
+// Every blueprint the window knows about, shared by all of its tabs.
+// Stored blueprints are never edited again (loading a deferred body aside) and never removed, so pointers to them stay valid.
+class BlueprintLibrary
+{
+public:
+    using Table = std::vector<std::shared_ptr<Blueprint>>;
+
+private:
+    Table table;
+    std::unordered_set<std::string> names;
+    std::unordered_map<std::string, size_t> numbered; // How many "Name (N)" there are for each Name
+    std::unordered_multimap<uint64_t, Blueprint*> byContent; // By Blueprint::contentHash, for those where it's known
+
+    void _AddName(const std::string& name);
+
+public:
+    // Starts out with the native blueprints
+    BlueprintLibrary();
+
+    // Storing invalidates iterators into this
+    const Table& GetBlueprints() const;
+
+    // A stored blueprint with the same body as bp, under any name, or null
+    Blueprint* FindIdentical(const Blueprint& bp);
+    // Stores a copy of bp, renamed if its name is taken, and returns the copy
+    Blueprint* Store(const Blueprint& bp);
+    Blueprint* Store(Blueprint&& bp);
+};
@@ -0,0 +1,51 @@
+#include <charconv>
+#include "BufferedWriter.h"
+
+BufferedWriter::BufferedWriter(const std::string& filename) :
+    file(filename, std::fstream::out | std::fstream::trunc | std::fstream::binary)
+{
+    buffer.reserve(g_capacity);
+}
+BufferedWriter::~BufferedWriter()
+{
+    Flush();
+}
+
+bool BufferedWriter::IsOpen() const
+{
+    return file.is_open();
+}
+
+BufferedWriter& BufferedWriter::operator<<(std::string_view text)
+{
+    buffer += text;
+    if (buffer.size() >= g_capacity)
+        Flush();
+    return *this;
+}
+BufferedWriter& BufferedWriter::operator<<(char ch)
+{
+    buffer += ch;
+    if (buffer.size() >= g_capacity)
+        Flush();
+    return *this;
+}
+BufferedWriter& BufferedWriter::operator<<(int value)
+{
+    char digits[16];
+    return *this << std::string_view(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+}
+BufferedWriter& BufferedWriter::operator<<(size_t value)
+{
+    char digits[24];
+    return *this << std::string_view(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+}
+
+void BufferedWriter::Flush()
+{
+    if (buffer.empty() || !file.is_open())
+        return;
+    file.write(buffer.data(), buffer.size());
+    file.flush(); // Past the stream's own buffer to the OS, though not synced to disk
+    buffer.clear();
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <string_view>
+
+// Output file that collects text in memory and writes it out in large blocks,
+// so writing many small pieces costs a buffer append each rather than a stream call each
+class BufferedWriter
+{
+public:
+    static constexpr size_t g_capacity = 1 << 20;
+
+private:
+    std::ofstream file;
+    std::string buffer;
+
+public:
+    explicit BufferedWriter(const std::string& filename);
+    ~BufferedWriter();
+
+    bool IsOpen() const;
+
+    BufferedWriter& operator<<(std::string_view text);
+    BufferedWriter& operator<<(char ch);
+    BufferedWriter& operator<<(int value);
+    BufferedWriter& operator<<(size_t value);
+
+    // Hands everything so far to the OS, so other readers of the file see it
+    void Flush();
+};
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include "HUtility.h"
+#include "Compression.h"
+
+namespace compression
+{
+    struct Header
+    {
+        char magic[4];
+        uint8_t version;
+        uint8_t filter;
+        uint8_t reserved[2];
+        uint32_t blockSize;
+        uint32_t blockCount;
+        uint64_t rawSize;
+    };
+    static_assert(sizeof(Header) == 24, "Header layout is part of the file format");
+    constexpr uint8_t g_version = 1;
+    // Set in a block's entry of the size table when it didn't compress and was stored as-is
+    constexpr uint32_t g_storedBit = 0x80000000u;
+
+    constexpr size_t g_minMatch = 4;
+    constexpr size_t g_lastLiterals = 5; // Matches stop short of the end of a block so the decoder never reads past it
+    constexpr size_t g_maxOffset = 0xFFFF;
+    // Most raw bytes a single packed byte can decode to, as a length byte of 255
+    constexpr uint64_t g_maxExpansion = 255;
+
+    static uint32_t Read32(const uint8_t* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static void WriteLength(std::string& out, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            out += (char)255;
+        }
+        out += (char)length;
+    }
+
+    // Literals, then a back-reference; matchLength 0 marks the final run of literals
+    static void WriteSequence(std::string& out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength)
+    {
+        size_t matchCode = matchLength ? matchLength - g_minMatch : 0;
+        out += (char)((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15));
+        if (literalLength >= 15)
+            WriteLength(out, literalLength - 15);
+        out.append((const char*)literals, literalLength);
+        if (!matchLength)
+            return;
+        out += (char)(offset & 0xFF);
+        out += (char)(offset >> 8);
+        if (matchCode >= 15)
+            WriteLength(out, matchCode - 15);
+    }
+
+    static void CompressBlock(const uint8_t* src, size_t size, std::string& out)
+    {
+        constexpr int hashBits = 14;
+        std::vector<uint32_t> table(1 << hashBits, 0);
+        auto hash = [](uint32_t sequence) { return (sequence * 2654435761u) >> (32 - hashBits); };
+
+        size_t anchor = 0;
+        size_t pos = 1;
+        const size_t matchEnd = size > g_lastLiterals ? size - g_lastLiterals : 0;
+        const size_t searchEnd = size > g_lastLiterals + g_minMatch + 3 ? size - (g_lastLiterals + g_minMatch + 3) : 0;
+        while (pos < searchEnd)
+        {
+            uint32_t sequence = Read32(src + pos);
+            uint32_t& entry = table[hash(sequence)];
+            size_t candidate = entry;
+            entry = (uint32_t)pos;
+            if (pos - candidate > g_maxOffset || Read32(src + candidate) != sequence)
+            {
+                ++pos;
+                continue;
+            }
+
+            size_t matchLength = g_minMatch;
+            while (pos + matchLength < matchEnd && src[candidate + matchLength] == src[pos + matchLength])
+            {
+                ++matchLength;
+            }
+            while (pos > anchor && candidate > 0 && src[pos - 1] == src[candidate - 1])
+            {
+                --pos;
+                --candidate;
+                ++matchLength;
+            }
+            WriteSequence(out, src + anchor, pos - anchor, pos - candidate, matchLength);
+            pos += matchLength;
+            anchor = pos;
+        }
+        WriteSequence(out, src + anchor, size - anchor, 0, 0);
+    }
+
+    static bool ReadLength(const uint8_t*& ip, const uint8_t* end, size_t& length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (ip >= end)
+                return false;
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    static bool DecompressBlock(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize)
+    {
+        const uint8_t* ip = src;
+        const uint8_t* const ipEnd = src + size;
+        uint8_t* op = dst;
+        uint8_t* const opEnd = dst + dstSize;
+        while (ip < ipEnd)
+        {
+            uint8_t token = *ip++;
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !ReadLength(ip, ipEnd, literalLength))
+                return false;
+            if (literalLength > (size_t)(ipEnd - ip) || literalLength > (size_t)(opEnd - op))
+                return false;
+            memcpy(op, ip, literalLength);
+            op += literalLength;
+            ip += literalLength;
+            if (ip == ipEnd)
+                break; // Final run of literals
+
+            if (ipEnd - ip < 2)
+                return false;
+            size_t offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > (size_t)(op - dst))
+                return false;
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !ReadLength(ip, ipEnd, matchLength))
+                return false;
+            matchLength += g_minMatch;
+            if (matchLength > (size_t)(opEnd - op))
+                return false;
+            const uint8_t* from = op - offset;
+            if (offset >= matchLength)
+            {
+                memcpy(op, from, matchLength);
+            }
+            else
+            {
+                // Overlapping copies repeat the last offset bytes
+                for (size_t i = 0; i < matchLength; ++i)
+                {
+                    op[i] = from[i];
+                }
+            }
+            op += matchLength;
+        }
+        return op == opEnd;
+    }
+
+    size_t ThreadCount(size_t blockCount)
+    {
+        return ParallelPieceCount(blockCount, 1);
+    }
+
+    // Blocks are handed out one at a time; each is already a large piece of work
+    template<typename Work>
+    static void ForEachBlock(size_t blockCount, Work&& work)
+    {
+        std::atomic_size_t nextBlock = 0;
+        ParallelPieces(ThreadCount(blockCount), [&](size_t)
+        {
+            for (size_t i; (i = nextBlock++) < blockCount;)
+            {
+                work(i);
+            }
+        });
+    }
+
+    bool IsCompressed(std::string_view data)
+    {
+        return data.size() >= sizeof(Header) && memcmp(data.data(), g_magic, sizeof(g_magic)) == 0;
+    }
+
+    void Compress(std::string_view raw, std::string& out, uint8_t filter)
+    {
+        const size_t blockCount = (raw.size() + g_blockSize - 1) / g_blockSize;
+        std::vector<std::string> blocks(blockCount);
+        ForEachBlock(blockCount, [&](size_t i)
+        {
+            std::string_view block = raw.substr(i * g_blockSize, g_blockSize);
+            CompressBlock((const uint8_t*)block.data(), block.size(), blocks[i]);
+        });
+
+        Header header = {};
+        memcpy(header.magic, g_magic, sizeof(g_magic));
+        header.version = g_version;
+        header.filter = filter;
+        header.blockSize = g_blockSize;
+        header.blockCount = (uint32_t)blockCount;
+        header.rawSize = raw.size();
+        out.append((const char*)&header, sizeof(header));
+        for (size_t i = 0; i < blockCount; ++i)
+        {
+            size_t rawSize = std::min<size_t>(g_blockSize, raw.size() - i * g_blockSize);
+            uint32_t entry = blocks[i].size() < rawSize ? (uint32_t)blocks[i].size() : (uint32_t)rawSize | g_storedBit;
+            out.append((const char*)&entry, sizeof(entry));
+        }
+        for (size_t i = 0; i < blockCount; ++i)
+        {
+            size_t rawSize = std::min<size_t>(g_blockSize, raw.size() - i * g_blockSize);
+            if (blocks[i].size() < rawSize)
+                out += blocks[i];
+            else
+                out += raw.substr(i * g_blockSize, rawSize);
+        }
+    }
+
+    bool Decompress(std::string_view packed, std::string& raw, uint8_t& filter)
+    {
+        if (!IsCompressed(packed))
+            return false;
+        Header header;
+        memcpy(&header, packed.data(), sizeof(header));
+        // A corrupt size would otherwise be allocated before any block is checked
+        if (header.rawSize / g_maxExpansion > packed.size())
+            return false;
+        if (header.version != g_version || header.blockSize == 0 ||
+            header.blockCount != (header.rawSize + header.blockSize - 1) / header.blockSize)
+            return false;
+        size_t tableSize = (size_t)header.blockCount * sizeof(uint32_t);
+        if (packed.size() - sizeof(header) < tableSize)
+            return false;
+
+        // Where each block starts, so they can be unpacked independently
+        std::vector<uint32_t> entries(header.blockCount);
+        memcpy(entries.data(), packed.data() + sizeof(header), tableSize);
+        std::vector<size_t> offsets(header.blockCount + 1);
+        offsets[0] = sizeof(header) + tableSize;
+        for (size_t i = 0; i < header.blockCount; ++i)
+        {
+            offsets[i + 1] = offsets[i] + (entries[i] & ~g_storedBit);
+        }
+        if (offsets.back() > packed.size())
+            return false;
+
+        raw.resize((size_t)header.rawSize);
+        std::vector<char> blockFailed(header.blockCount, false);
+        ForEachBlock(header.blockCount, [&](size_t i)
+        {
+            const uint8_t* src = (const uint8_t*)packed.data() + offsets[i];
+            size_t srcSize = offsets[i + 1] - offsets[i];
+            uint8_t* dst = (uint8_t*)raw.data() + i * header.blockSize;
+            size_t dstSize = std::min<size_t>(header.blockSize, raw.size() - i * header.blockSize);
+            if (entries[i] & g_storedBit)
+            {
+                if (srcSize != dstSize)
+                    blockFailed[i] = true;
+                else
+                    memcpy(dst, src, srcSize);
+            }
+            else if (!DecompressBlock(src, srcSize, dst, dstSize))
+            {
+                blockFailed[i] = true;
+            }
+        });
+        if (std::find(blockFailed.begin(), blockFailed.end(), true) != blockFailed.end())
+            return false;
+        filter = header.filter;
+        return true;
+    }
+
+    bool Unpack(std::string_view data, std::string& storage, std::string_view& contents, uint8_t& filter)
+    {
+        if (!IsCompressed(data))
+        {
+            contents = data;
+            filter = 0;
+            return true;
+        }
+        if (!Decompress(data, storage, filter))
+            return false;
+        contents = storage;
+        return true;
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Block-compressed container for session and blueprint files.
+// The payload is cut into fixed-size blocks, each compressed on its own with a small LZ77 codec (LZ4-style sequences),
+// so blocks can be compressed and decompressed in parallel. Readers detect the container by its magic and unpack it
+// transparently; writers only use it when asked to.
+namespace compression
+{
+    constexpr char g_magic[4] = { 'E', 'A', 'Z', '\0' };
+    constexpr uint32_t g_blockSize = 1 << 20;
+
+    bool IsCompressed(std::string_view data);
+    // Threads a payload of blockCount blocks is spread across when packing or unpacking it
+    size_t ThreadCount(size_t blockCount);
+
+    // Appends raw to out in compressed form. filter is stored for the caller to interpret when unpacking,
+    // e.g. to undo a transform it applied to raw beforehand; 0 means none.
+    void Compress(std::string_view raw, std::string& out, uint8_t filter = 0);
+    // Replaces raw with the decompressed payload of packed. Returns false if packed is damaged.
+    bool Decompress(std::string_view packed, std::string& raw, uint8_t& filter);
+
+    // Points contents at data itself if it isn't compressed, or at storage holding the decompressed payload if it is.
+    // filter is 0 for uncompressed data. Returns false if data is a damaged container.
+    bool Unpack(std::string_view data, std::string& storage, std::string_view& contents, uint8_t& filter);
+}
@@ -1,39 +1,43 @@
-#include <regex>
+#include <cmath>
 #include <thread>
 #include <unordered_set>
+#include <filesystem>
 #include <fstream>
 #include <queue>
 #include <stack>
+#include <utility>
 #include "HUtility.h"
 #include "Blueprint.h"
 #include "Graph.h"
 #include "Tab.h"
 #include "Tool.h"
 #include "Window.h"
-#include "NativeBlueprints.h"
+#include "GraphBinary.h"
+#include "GraphText.h"
+#include "Compression.h"
+#include "BufferedWriter.h"
 
 Graph::Graph(Tab* owner, const std::string& name) : owningTab(owner), name(name)
 {
-    blueprints.reserve(_countof(nativeBlueprints));
-    for (const Blueprint& bp : nativeBlueprints)
-    {
-        blueprints.push_back(new Blueprint(bp));
-    }
-    Log(LogType::info, "Constructed graph " + name);
+    Log(LogType::info, "Constructed graph {}", name);
 }
 Graph::~Graph()
 {
     _Free();
 }
 
-void Graph::Log(LogType type, const std::string& what) const
+Logger& Graph::_GetLogger() const
+{
+    return owningTab->owningWindow->logger;
+}
+void Graph::_Log(LogEvent&& event) const
 {
-    owningTab->owningWindow->Log(type, "[Graph] " + what);
+    owningTab->owningWindow->Log(std::move(event));
 }
 
 void Graph::_Free()
 {
-    Log(LogType::info, "Freed graph " + name);
+    Log(LogType::info, "Freed graph {}", name);
     for (Node* node : nodes)
     {
         delete node;
@@ -42,14 +46,11 @@ void Graph::_Free()
     {
         delete wire;
     }
-    for (Blueprint* bp : blueprints)
-    {
-        delete bp;
-    }
     for (Group* group : groups)
     {
         delete group;
     }
+    _ClearRenderChunks();
 }
 
 void Graph::_Clear()
@@ -57,12 +58,531 @@ void Graph::_Clear()
     _Free();
 }
 
+void Graph::_AssignHandle(Node* node, NodeHandle handle)
+{
+    if (handle == g_newHandle)
+    {
+        if (freeHandles.empty() && handles.size() >= handleSweepAt)
+            _SweepHandles();
+        if (!freeHandles.empty())
+        {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+            handles[handle] = node;
+        }
+        else
+        {
+            // Saved files can't hold handles past this, so going on would lose the session at the next load
+            if (handles.size() >= g_maxRecordIndex)
+            {
+                _ASSERT_EXPR(false, L"Out of node handles");
+                Log(LogType::error, "Out of node handles ({} in use)", handles.size());
+                FlushJournal();
+                exit(1);
+            }
+            handle = (NodeHandle)handles.size();
+            handles.push_back(node);
+        }
+    }
+    else
+    {
+        _ASSERT_EXPR(handle < handles.size() && !handles[handle], L"Node handle is already in use");
+        handles[handle] = node;
+    }
+    node->m_handle = handle;
+    node->m_owningGraph = this;
+    if (nodeRecords.Size() < handles.size())
+        nodeRecords.Grow(handles.size());
+    _SyncNodeRecord(node);
+}
+void Graph::_SweepHandles()
+{
+    std::vector<bool> referenced(handles.size(), false);
+    history.MarkNodeHandles(referenced);
+    // Highest first, so the lowest come off the back first
+    for (size_t handle = handles.size(); handle-- > 0;)
+    {
+        if (!handles[handle] && !referenced[handle])
+            freeHandles.push_back((NodeHandle)handle);
+    }
+    // Sweep again as soon as these run out if that was worth it; otherwise the history is holding most of them, so grow first
+    size_t held = handles.size() - freeHandles.size();
+    size_t room = std::max(g_minHandleSweep, held / 2);
+    handleSweepAt = freeHandles.size() >= room ? handles.size() : handles.size() + room;
+}
+Node* Graph::_FromHandle(NodeHandle handle) const
+{
+    _ASSERT_EXPR(handle < handles.size() && !!handles[handle], L"Stale node handle");
+    return handles[handle];
+}
+Edit Graph::_NodeEdit(Edit::Type type, const Node* node) const
+{
+    Edit edit{ .type = type };
+    edit.gate = node->m_gate;
+    edit.extraParam = node->GetExtraParam();
+    edit.node = node->m_handle;
+    edit.position = node->m_position;
+    return edit;
+}
+Edit Graph::_WireEdit(Edit::Type type, const Wire* wire) const
+{
+    Edit edit{ .type = type };
+    edit.elbowConfig = wire->elbowConfig;
+    edit.node = wire->start->m_handle;
+    edit.other = wire->end->m_handle;
+    return edit;
+}
+void Graph::_Record(const Edit& edit, const std::string& name)
+{
+    if (!replayingHistory)
+        history.Record(edit, name);
+}
+void Graph::_RecordGroup(Edit::Type type, const Group* group)
+{
+    if (replayingHistory)
+        return;
+    Edit edit{ .type = type };
+    edit.groupPosition = (uint32_t)(std::find(groups.begin(), groups.end(), group) - groups.begin());
+    history.Record(edit, GroupRecord{ group->captureBounds, group->color, group->label });
+}
+
+IVec2 Graph::_NodeChunkOf(IVec2 pos)
+{
+    // Floor division, so that negative coordinates don't share chunk 0
+    auto chunkOf = [](int x) { return (x >= 0 ? x : x - (g_nodeChunkSize - 1)) / g_nodeChunkSize; };
+    return IVec2(chunkOf(pos.x), chunkOf(pos.y));
+}
+void Graph::_IndexNode(Node* node)
+{
+    node->m_collisionPosition = node->m_position;
+    IVec2 chunk = _NodeChunkOf(node->m_collisionPosition);
+    nodeChunks[chunk].push_back(node);
+    if (densityActive.size() <= node->m_handle)
+        densityActive.resize(handles.size(), false);
+    densityActive[node->m_handle] = node->m_state;
+    _CountDensity(chunk, 1, node->m_state ? 1 : 0);
+    _InvalidateNodeLayers(chunk);
+}
+void Graph::_CountDensity(IVec2 chunk, int nodeDelta, int activeDelta)
+{
+    for (int level = 0; level < g_densityLevels; ++level)
+    {
+        // Arithmetic shift floors, so negative chunks group the same way positive ones do
+        IVec2 tilePos(chunk.x >> level, chunk.y >> level);
+        DensityTile& tile = densityTiles[level][tilePos];
+        tile.nodes += nodeDelta;
+        tile.active += activeDelta;
+        if (tile.nodes == 0)
+            densityTiles[level].erase(tilePos);
+    }
+}
+void Graph::_UnindexNode(Node* node)
+{
+    _CountDensity(_NodeChunkOf(node->m_collisionPosition), -1, densityActive[node->m_handle] ? -1 : 0);
+    _InvalidateNodeLayers(_NodeChunkOf(node->m_collisionPosition));
+    auto it = nodeChunks.find(_NodeChunkOf(node->m_collisionPosition));
+    _ASSERT_EXPR(it != nodeChunks.end(), L"Node missing from collision index");
+    if (it == nodeChunks.end())
+        return;
+    FindAndErase_ExpectExisting(it->second, node);
+    if (it->second.empty())
+        nodeChunks.erase(it);
+}
+void Graph::_MoveNodeCollision(Node* node)
+{
+    if (node->m_collisionPosition == node->m_position)
+        return;
+
+    Edit edit{ .type = Edit::Type::Translate };
+    edit.node = node->m_handle;
+    edit.position = node->m_position - node->m_collisionPosition;
+    _Record(edit);
+
+    for (Wire* wire : node->m_wires)
+    {
+        _UnindexWire(wire, wire->elbowConfig);
+    }
+    if (_NodeChunkOf(node->m_collisionPosition) == _NodeChunkOf(node->m_position))
+    {
+        node->m_collisionPosition = node->m_position;
+        _InvalidateNodeLayers(_NodeChunkOf(node->m_collisionPosition));
+    }
+    else
+    {
+        _UnindexNode(node);
+        _IndexNode(node);
+    }
+    for (Wire* wire : node->m_wires)
+    {
+        _IndexWire(wire);
+    }
+}
+
+void Graph::_WireChunksOf(std::vector<IVec2>& chunks, IVec2 start, IVec2 end, ElbowConfig elbowConfig)
+{
+    auto addSegment = [&chunks](IVec2 a, IVec2 b)
+    {
+        if (b.x < a.x)
+            std::swap(a, b);
+        IVec2 minChunk = _NodeChunkOf(a);
+        IVec2 maxChunk = _NodeChunkOf(b);
+        // Walk the columns of chunks; legal segments are cardinal or 45 degrees, so each column covers a contiguous run of rows
+        for (int column = minChunk.x; column <= maxChunk.x; ++column)
+        {
+            int x0 = std::max(a.x, column * g_nodeChunkSize);
+            int x1 = std::min(b.x, column * g_nodeChunkSize + g_nodeChunkSize - 1);
+            int y0 = a.y;
+            int y1 = b.y;
+            if (a.x != b.x)
+            {
+                y0 = a.y + (b.y - a.y) * (x0 - a.x) / (b.x - a.x);
+                y1 = a.y + (b.y - a.y) * (x1 - a.x) / (b.x - a.x);
+            }
+            if (y1 < y0)
+                std::swap(y0, y1);
+            int minRow = _NodeChunkOf(IVec2(x0, y0)).y;
+            int maxRow = _NodeChunkOf(IVec2(x1, y1)).y;
+            for (int row = minRow; row <= maxRow; ++row)
+            {
+                chunks.emplace_back(column, row);
+            }
+        }
+    };
+
+    IVec2 elbow = Wire::GetLegalElbowPosition(start, end, elbowConfig);
+    chunks.clear();
+    addSegment(start, elbow);
+    addSegment(elbow, end);
+    std::sort(chunks.begin(), chunks.end(), [](IVec2 a, IVec2 b) { return a.y < b.y || (a.y == b.y && a.x < b.x); });
+    chunks.erase(std::unique(chunks.begin(), chunks.end()), chunks.end());
+}
+void Graph::_IndexWire(Wire* wire)
+{
+    thread_local std::vector<IVec2> chunks;
+    _WireChunksOf(chunks, wire->start->m_collisionPosition, wire->end->m_collisionPosition, wire->elbowConfig);
+    for (IVec2 chunk : chunks)
+    {
+        wireChunks[chunk].push_back(wire);
+    }
+    _InvalidateWireLayers(chunks);
+    // Whether a node is drawn as a passthrough depends on its wires
+    _InvalidateNodeLayers(_NodeChunkOf(wire->start->m_collisionPosition));
+    _InvalidateNodeLayers(_NodeChunkOf(wire->end->m_collisionPosition));
+}
+void Graph::_UnindexWire(Wire* wire, ElbowConfig elbowConfig)
+{
+    thread_local std::vector<IVec2> chunks;
+    _WireChunksOf(chunks, wire->start->m_collisionPosition, wire->end->m_collisionPosition, elbowConfig);
+    _InvalidateWireLayers(chunks);
+    _InvalidateNodeLayers(_NodeChunkOf(wire->start->m_collisionPosition));
+    _InvalidateNodeLayers(_NodeChunkOf(wire->end->m_collisionPosition));
+    for (IVec2 chunk : chunks)
+    {
+        auto it = wireChunks.find(chunk);
+        _ASSERT_EXPR(it != wireChunks.end(), L"Wire missing from collision index");
+        if (it == wireChunks.end())
+            continue;
+        std::vector<Wire*>& chunkWires = it->second;
+        auto wireIt = std::find(chunkWires.begin(), chunkWires.end(), wire);
+        _ASSERT_EXPR(wireIt != chunkWires.end(), L"Wire missing from collision index");
+        if (wireIt == chunkWires.end())
+            continue;
+        // Order within a chunk doesn't matter
+        *wireIt = chunkWires.back();
+        chunkWires.pop_back();
+        if (chunkWires.empty())
+            wireChunks.erase(it);
+    }
+}
+
+bool Graph::_IsDragged(const Node* node) const
+{
+    return node->m_handle < dragMembership.size() && dragMembership[node->m_handle];
+}
+void Graph::_TranslateNodes(const std::vector<Node*>& moving, IVec2 offset)
+{
+    if (offset == IVec2::Zero())
+        return;
+
+    EditGroup group(*this);
+    for (const Node* node : moving)
+    {
+        Edit edit{ .type = Edit::Type::Translate };
+        edit.node = node->m_handle;
+        edit.position = offset;
+        _Record(edit);
+    }
+
+    std::unordered_set<Node*> movingSet(moving.begin(), moving.end());
+
+    // A wire between two moving nodes would otherwise be unindexed and reindexed twice
+    std::vector<Wire*> touched;
+    for (Node* node : moving)
+    {
+        for (Wire* wire : node->m_wires)
+        {
+            Node* other = wire->start == node ? wire->end : wire->start;
+            if (wire->start == node || !movingSet.contains(other))
+                touched.push_back(wire);
+        }
+    }
+
+    for (Wire* wire : touched)
+    {
+        _UnindexWire(wire, wire->elbowConfig);
+    }
+    for (Node* node : moving)
+    {
+        node->m_position += offset;
+        if (_NodeChunkOf(node->m_collisionPosition) == _NodeChunkOf(node->m_position))
+        {
+            node->m_collisionPosition = node->m_position;
+        }
+        else
+        {
+            _UnindexNode(node);
+            _IndexNode(node);
+        }
+        _SyncNodeRecord(node);
+    }
+    for (Wire* wire : touched)
+    {
+        wire->UpdateElbowToLegal();
+        _IndexWire(wire);
+    }
+}
+
+void Graph::_SyncNodeRecord(const Node* node)
+{
+    NodeRecord& record = nodeRecords.Edit(node->m_handle);
+    record.live = true;
+    record.gate = node->m_gate;
+    record.extraParam = node->GetExtraParam();
+    record.position = node->m_position;
+    if (record.name != node->m_name)
+        record.name = node->m_name;
+    if (journal.IsOpen())
+        journal.WriteNode(node->m_handle, record);
+    // Gate, parameter or position may have changed
+    if (!renderChunks.empty())
+        _InvalidateNodeLayers(_NodeChunkOf(node->m_collisionPosition));
+}
+void Graph::_ReleaseNodeRecord(const Node* node)
+{
+    nodeRecords.Edit(node->m_handle) = NodeRecord();
+    if (journal.IsOpen())
+        journal.WriteNodeReleased(node->m_handle);
+}
+void Graph::_AcquireWireRecord(Wire* wire)
+{
+    if (freeWireRecords.empty())
+    {
+        if (wireRecords.Size() >= g_maxRecordIndex)
+        {
+            _ASSERT_EXPR(false, L"Out of wire slots");
+            Log(LogType::error, "Out of wire slots ({} in use)", wireRecords.Size());
+            FlushJournal();
+            exit(1);
+        }
+        wire->recordIndex = (uint32_t)wireRecords.Size();
+        wireRecords.Grow(wireRecords.Size() + 1);
+    }
+    else
+    {
+        wire->recordIndex = freeWireRecords.back();
+        freeWireRecords.pop_back();
+    }
+    _SyncWireRecord(wire);
+}
+void Graph::_SyncWireRecord(const Wire* wire)
+{
+    WireRecord& record = wireRecords.Edit(wire->recordIndex);
+    record.live = true;
+    record.elbowConfig = wire->elbowConfig;
+    record.start = wire->start->m_handle;
+    record.end = wire->end->m_handle;
+    if (journal.IsOpen())
+        journal.WriteWire(wire->recordIndex, record);
+}
+void Graph::_ReleaseWireRecord(const Wire* wire)
+{
+    wireRecords.Edit(wire->recordIndex) = WireRecord();
+    freeWireRecords.push_back(wire->recordIndex);
+    if (journal.IsOpen())
+        journal.WriteWireReleased(wire->recordIndex);
+}
+void Graph::_Replay(const EditBatch& batch, bool undo)
+{
+    replayingHistory = true;
+
+    // Consecutive edits of the same kind are applied together so that undoing a large paste doesn't go quadratic
+    std::vector<Node*> createdNodes;
+    std::vector<Node*> destroyedNodes;
+    std::vector<std::pair<Node*, Node*>> connections;
+    std::vector<ElbowConfig> elbowConfigs;
+    std::vector<Wire*> destroyedWires;
+    std::vector<Node*> translatedNodes;
+    IVec2 translation = IVec2::Zero();
+    auto flush = [&]()
+    {
+        if (!createdNodes.empty())
+        {
+            _InsertNodes(createdNodes);
+            createdNodes.clear();
+        }
+        if (!destroyedNodes.empty())
+        {
+            _DestroyNodes(destroyedNodes);
+            destroyedNodes.clear();
+        }
+        if (!connections.empty())
+        {
+            _CreateWires(connections, elbowConfigs, ElbowConfig(0));
+            connections.clear();
+            elbowConfigs.clear();
+        }
+        if (!destroyedWires.empty())
+        {
+            _DestroyWires(destroyedWires);
+            destroyedWires.clear();
+        }
+        if (!translatedNodes.empty())
+        {
+            _TranslateNodes(translatedNodes, translation);
+            translatedNodes.clear();
+        }
+    };
+
+    Edit::Type lastType = Edit::Type::CreateNode;
+    for (size_t i = 0; i < batch.edits.size(); ++i)
+    {
+        const Edit& edit = batch.edits[undo ? batch.edits.size() - 1 - i : i];
+
+        Edit::Type type = edit.type;
+        if (undo)
+        {
+            switch (type)
+            {
+            case Edit::Type::CreateNode:  type = Edit::Type::DestroyNode; break;
+            case Edit::Type::DestroyNode: type = Edit::Type::CreateNode;  break;
+            case Edit::Type::CreateWire:  type = Edit::Type::DestroyWire; break;
+            case Edit::Type::DestroyWire: type = Edit::Type::CreateWire;  break;
+            case Edit::Type::CreateGroup:  type = Edit::Type::DestroyGroup; break;
+            case Edit::Type::DestroyGroup: type = Edit::Type::CreateGroup;  break;
+            }
+        }
+        IVec2 offset = undo ? IVec2::Zero() - edit.position : edit.position;
+        if (type != lastType || (type == Edit::Type::Translate && offset != translation))
+            flush();
+        lastType = type;
+
+        switch (type)
+        {
+        case Edit::Type::CreateNode:
+        {
+            const char* name = edit.nameIndex == Edit::g_noName ? "" : batch.names[edit.nameIndex].c_str();
+            createdNodes.push_back(_AllocNode(Node(name, edit.position, edit.gate, edit.extraParam), edit.node));
+        }
+        break;
+
+        case Edit::Type::DestroyNode:
+            destroyedNodes.push_back(_FromHandle(edit.node));
+            break;
+
+        case Edit::Type::CreateWire:
+            connections.emplace_back(_FromHandle(edit.node), _FromHandle(edit.other));
+            elbowConfigs.push_back(edit.elbowConfig);
+            break;
+
+        case Edit::Type::DestroyWire:
+        {
+            Wire* wire = _FromHandle(edit.node)->FindConnection(_FromHandle(edit.other));
+            _ASSERT_EXPR(!!wire, L"History refers to a wire that doesn't exist");
+            if (wire)
+                destroyedWires.push_back(wire);
+        }
+        break;
+
+        case Edit::Type::SwapGates:
+        {
+            Node* a = _FromHandle(edit.node);
+            Node* b = _FromHandle(edit.other);
+            std::swap(a->m_gate, b->m_gate);
+            _SyncNodeRecord(a);
+            _SyncNodeRecord(b);
+        }
+        break;
+
+        case Edit::Type::Retype:
+        {
+            Node* node = _FromHandle(edit.node);
+            node->m_gate = undo ? edit.prevGate : edit.gate;
+            node->m_ntd.r.resistance = undo ? edit.prevExtraParam : edit.extraParam; // Hack: resistance being used as generic ntd data
+            _SyncNodeRecord(node);
+        }
+        break;
+
+        case Edit::Type::Translate:
+            translatedNodes.push_back(_FromHandle(edit.node));
+            translation = offset;
+            break;
+
+        case Edit::Type::CreateGroup:
+        {
+            const GroupRecord& record = batch.groups[edit.groupIndex];
+            groups.insert(groups.begin() + edit.groupPosition, new Group(record.captureBounds, record.color, record.label));
+            groupChunksDirty = true;
+        }
+        break;
+
+        case Edit::Type::DestroyGroup:
+        {
+            Group* group = groups[edit.groupPosition];
+            if (reshapedGroup == group)
+                reshapedGroup = nullptr;
+            groups.erase(groups.begin() + edit.groupPosition);
+            delete group;
+            groupChunksDirty = true;
+        }
+        break;
+
+        case Edit::Type::ReshapeGroup:
+            groups[edit.groupPosition]->SetCaptureBounds(batch.groups[edit.groupIndex + (undo ? 0 : 1)].captureBounds);
+            groupChunksDirty = true;
+            break;
+
+        ASSERT_SPECIALIZATION(L"edit replay");
+        }
+    }
+    flush();
+
+    replayingHistory = false;
+    orderDirty = true;
+}
+
+Node* Graph::_AllocNode(Node&& base, NodeHandle handle)
+{
+    Node* node = new Node(std::move(base));
+    _AssignHandle(node, handle);
+    _Record(_NodeEdit(Edit::Type::CreateNode, node), node->GetName());
+    return node;
+}
+void Graph::_InsertNodes(const std::vector<Node*>& newNodes)
+{
+    nodes.insert(nodes.begin(), newNodes.begin(), newNodes.end());
+    startNodes.insert(startNodes.end(), newNodes.begin(), newNodes.end());
+    for (Node* node : newNodes)
+    {
+        _IndexNode(node);
+    }
+}
 Node* Graph::_CreateNode(Node&& base)
 {
-    Node* node = new Node(base);
+    Node* node = _AllocNode(std::move(base));
     nodes.insert(nodes.begin(), node);
     startNodes.push_back(node);
-    Log(LogType::info, "Created new node");
+    _IndexNode(node);
+    Log(LogType::info, LogCategory::elements, "Created new node");
     return node;
 }
 void Graph::_ClearNodeReferences(Node* node)
@@ -77,23 +597,78 @@ void Graph::_ClearNodeReferences(Node* node)
         output->end->RemoveWire_Expected(output);
         _DestroyWire(output);
     }
-    Log(LogType::info, "Cleared references to node");
+    Log(LogType::info, LogCategory::elements, "Cleared references to node");
     orderDirty = true;
 }
 void Graph::_DestroyNode(Node* node)
 {
+    if (_IsDragged(node))
+        EndDrag(false);
+    _Record(_NodeEdit(Edit::Type::DestroyNode, node), node->GetName());
+    _ReleaseNodeRecord(node);
+    _UnindexNode(node);
+    handles[node->m_handle] = nullptr;
     FindAndErase_ExpectExisting(nodes, node);
     FindAndErase(startNodes, node);
     delete node;
-    Log(LogType::info, "Destroyed node");
+    Log(LogType::info, LogCategory::elements, "Destroyed node");
     orderDirty = true;
 }
+void Graph::_DestroyNodes(const std::vector<Node*>& removeList)
+{
+    std::unordered_set<Node*> removeSet(removeList.begin(), removeList.end());
 
-Wire* Graph::_CreateWire(Wire&& base)
+    std::vector<Wire*> attached;
+    {
+        std::unordered_set<Wire*> visited;
+        for (Node* node : removeSet)
+        {
+            for (Wire* wire : node->GetWires())
+            {
+                if (visited.insert(wire).second)
+                    attached.push_back(wire);
+            }
+        }
+    }
+    _DestroyWires(attached);
+
+    std::unordered_set<Node*> remaining = removeSet;
+    for (Node* node : removeList)
+    {
+        if (!remaining.erase(node))
+            continue; // Duplicate
+        if (_IsDragged(node))
+            EndDrag(false);
+        _Record(_NodeEdit(Edit::Type::DestroyNode, node), node->GetName());
+        _ReleaseNodeRecord(node);
+        _UnindexNode(node);
+        handles[node->m_handle] = nullptr;
+    }
+    std::erase_if(nodes, [&removeSet](Node* node) { return removeSet.contains(node); });
+    std::erase_if(startNodes, [&removeSet](Node* node) { return removeSet.contains(node); });
+    for (Node* node : removeSet)
+    {
+        delete node;
+    }
+    Log(LogType::info, "Destroyed {} nodes", removeSet.size());
+    orderDirty = true;
+}
+
+Wire* Graph::_InsertWire(Wire&& base)
 {
     Wire* wire = new Wire(base);
     wires.push_back(wire);
-    Log(LogType::info, "Created wire");
+    _IndexWire(wire);
+    _AcquireWireRecord(wire);
+    _Record(_WireEdit(Edit::Type::CreateWire, wire));
+    wire->start->AddWireOutput(wire);
+    wire->end->AddWireInput(wire);
+    return wire;
+}
+Wire* Graph::_CreateWire(Wire&& base)
+{
+    Wire* wire = _InsertWire(std::move(base));
+    Log(LogType::info, LogCategory::elements, "Created wire");
     return wire;
 }
 void Graph::_ClearWireReferences(Wire* wire)
@@ -103,17 +678,44 @@ void Graph::_ClearWireReferences(Wire* wire)
     // Push end to start nodes if this has destroyed its last remaining input
     if (wire->end->IsOutputOnly())
         startNodes.push_back(wire->end);
-    Log(LogType::info, "Cleared references to wire");
+    Log(LogType::info, LogCategory::elements, "Cleared references to wire");
     orderDirty = true;
 }
 void Graph::_DestroyWire(Wire* wire)
 {
+    _Record(_WireEdit(Edit::Type::DestroyWire, wire));
+    _ReleaseWireRecord(wire);
+    _UnindexWire(wire, wire->elbowConfig);
     FindAndErase_ExpectExisting(wires, wire);
     delete wire;
-    Log(LogType::info, "Destroyed wire");
+    Log(LogType::info, LogCategory::elements, "Destroyed wire");
+    orderDirty = true;
+}
+void Graph::_DestroyWires(const std::vector<Wire*>& removeList)
+{
+    std::unordered_set<Wire*> removeSet;
+    removeSet.reserve(removeList.size());
+    for (Wire* wire : removeList)
+    {
+        if (!removeSet.insert(wire).second)
+            continue; // Duplicate
+        _Record(_WireEdit(Edit::Type::DestroyWire, wire));
+        _ReleaseWireRecord(wire);
+        _UnindexWire(wire, wire->elbowConfig);
+        wire->start->RemoveWire_Expected(wire);
+        wire->end->RemoveWire_Expected(wire);
+        // Push end to start nodes if this has destroyed its last remaining input
+        if (wire->end->IsOutputOnly())
+            startNodes.push_back(wire->end);
+    }
+    std::erase_if(wires, [&removeSet](Wire* wire) { return removeSet.contains(wire); });
+    for (Wire* wire : removeSet)
+    {
+        delete wire;
+    }
+    Log(LogType::info, "Destroyed {} wires", removeSet.size());
     orderDirty = true;
 }
-
 
 bool Graph::IsOrderDirty() const
 {
@@ -139,6 +741,7 @@ Node* Graph::CreateNode(IVec2 position, Gate gate, uint8_t extendedParam)
 }
 void Graph::DestroyNode(Node* node)
 {
+    EditGroup group(*this);
     _ClearNodeReferences(node);
     _DestroyNode(node);
     orderDirty = true;
@@ -154,88 +757,10 @@ size_t Graph::StartNodeID(Node* node)
     return std::find(startNodes.begin(), startNodes.end(), node) - startNodes.begin();
 }
 
-void Graph::DestroyNodes(std::vector<Node*>& removeList)
+void Graph::DestroyNodes(const std::vector<Node*>& removeList)
 {
-    // Todo...
-#if 0
-    std::unordered_set<Node*> internals(removeList.begin(), removeList.end());
-    std::unordered_set<Wire*> uniqueWires;
-
-    auto aLambda = [&]()
-    {
-        for (Node* node : removeList)
-        {
-            for (Wire* wire : node->GetWires())
-            {
-                uniqueWires.insert(wire);
-            }
-        }
-    };
-    auto bLambda = [&]()
-    {
-        for (Node* node : removeList)
-        {
-            for (Wire* wire : node->GetWires())
-            {
-                uniqueWires.insert(wire);
-            }
-            for (Wire* wire : node->GetInputs())
-            {
-                if (internals.find(wire->start) == internals.end())
-                    wire->start->RemoveWire_Expected(wire);
-            }
-            for (Wire* wire : node->GetOutputs())
-            {
-                if (internals.find(wire->end) == internals.end())
-                    wire->end->RemoveWire_Expected(wire);
-            }
-        }
-    };
-    auto thread1Lambda = [&]()
-    {
-        std::stable_partition(nodes.begin(), nodes.end(), [&internals](Node* node) { return internals.find(node) != internals.end(); });
-        while (internals.find(nodes.back()) != internals.end())
-        {
-            delete nodes.back();
-            nodes.pop_back();
-        }
-    };
-    auto thread2Lambda = [&]()
-    {
-        std::stable_partition(startNodes.begin(), startNodes.end(), [&internals](Node* node) { return internals.find(node) != internals.end(); });
-        while (internals.find(startNodes.back()) != internals.end())
-        {
-            delete startNodes.back();
-            startNodes.pop_back();
-        }
-    };
-    auto thread3Lambda = [&]()
-    {
-        std::stable_partition(wires.begin(), wires.end(), [&uniqueWires](Wire* wire) { return uniqueWires.find(wire) != uniqueWires.end(); });
-        while (uniqueWires.find(wires.back()) != uniqueWires.end())
-        {
-            delete wires.back();
-            wires.pop_back();
-        }
-    };
-
-    std::thread a(aLambda);
-    std::thread b(bLambda);
-    a.join();
-    b.join();
-    std::thread thread1(thread1Lambda, std::cref(internals), std::ref(nodes));
-    std::thread thread2(thread2Lambda, std::cref(internals), std::ref(startNodes));
-    std::thread thread3(thread3Lambda, std::cref(uniqueWires), std::ref(wires));
-    thread1.join();
-    thread2.join();
-    thread3.join();
-#else
-    for (Node* node : removeList)
-    {
-        DestroyNode(node);
-    }
-#endif
-    orderDirty = true;
+    EditGroup group(*this);
+    _DestroyNodes(removeList);
 }
 
 void Graph::BypassNode(Node* node)
@@ -246,6 +771,7 @@ void Graph::BypassNode(Node* node)
         Log(LogType::warning, "Node not bypassable");
         return;
     }
+    EditGroup group(*this);
     // Multiple outputs, one input
     if (node->GetInputCount() == 1)
     {
@@ -276,6 +802,7 @@ void Graph::BypassNode_Complex(Node* node)
         Log(LogType::error, "Node is not complex bypassable");
         return;
     }
+    EditGroup group(*this);
 
     for (Wire* input : node->GetInputs())
     {
@@ -301,6 +828,7 @@ Node* Graph::MergeNodes(Node* depricating, Node* overriding)
         Log(LogType::error, "Cannot merge with self");
         exit(1);
     }
+    EditGroup group(*this);
 
     // Hack: resistance being used as generic ntd data
     Node* c = CreateNode(depricating->GetPosition(), overriding->GetGate(), overriding->m_ntd.r.resistance);
@@ -352,24 +880,19 @@ Wire* Graph::CreateWire(Node* start, Node* end, ElbowConfig elbowConfig)
         return nullptr;
     }
 
+    EditGroup group(*this);
+
     // Duplicate guard
+    if (Wire* wire = end->FindConnection(start))
     {
-        auto it = end->FindConnection(start);
-        if (end->IsValidConnection(it))
-        {
-            Wire* wire = *it;
-            if (start == wire->start) // Wire already matches
-                return wire;
-            else if (start == wire->end) // Wire is reverse of existing
-                return ReverseWire(wire);
-        }
+        if (start == wire->start) // Wire already matches
+            return wire;
+        else if (start == wire->end) // Wire is reverse of existing
+            return ReverseWire(wire);
     }
 
     Wire* wire = _CreateWire(Wire(start, end, elbowConfig));
 
-    start->AddWireOutput(wire);
-    end->AddWireInput(wire);
-
     // Remove end from start nodes, as it is no longer an inputless node with this change
     FindAndErase(startNodes, end);
 
@@ -377,8 +900,66 @@ Wire* Graph::CreateWire(Node* start, Node* end, ElbowConfig elbowConfig)
     Log(LogType::success, "Wire complete");
     return wire;
 }
+size_t Graph::_CreateWires(std::span<const std::pair<Node*, Node*>> connections, std::span<const ElbowConfig> elbowConfigs, ElbowConfig elbowConfig)
+{
+    Log(LogType::attempt, "Wiring {} connections", connections.size());
+    _ASSERT_EXPR(elbowConfigs.empty() || elbowConfigs.size() == connections.size(), L"Elbow config count mismatch");
+    EditGroup group(*this);
+
+    wires.reserve(wires.size() + connections.size());
+
+    std::unordered_set<Node*> fedNodes;
+    size_t created = 0;
+    size_t skipped = 0;
+    for (size_t i = 0; i < connections.size(); ++i)
+    {
+        auto [start, end] = connections[i];
+        if (!start || !end || start == end)
+        {
+            _ASSERT_EXPR(false, L"Cannot wire to null or self");
+            ++skipped;
+            continue;
+        }
+
+        // Duplicate guard; hubs on either side of a bridge are hashed by the node itself
+        if (Wire* existing = end->FindConnection(start))
+        {
+            if (start == existing->end) // Wire is reverse of existing
+            {
+                // Its old end may have just lost its only input, and ReverseWire already put it back in startNodes
+                fedNodes.erase(existing->end);
+                ReverseWire(existing);
+            }
+            ++skipped;
+            continue;
+        }
+
+        _InsertWire(Wire(start, end, elbowConfigs.empty() ? elbowConfig : elbowConfigs[i]));
+        fedNodes.insert(end);
+        ++created;
+    }
+
+    // Remove ends from start nodes, as they are no longer inputless nodes with this change
+    if (!fedNodes.empty())
+    {
+        std::erase_if(startNodes, [&fedNodes](Node* node) { return fedNodes.contains(node); });
+        orderDirty = true;
+    }
+
+    Log(LogType::success, "Created {} wires ({} skipped)", created, skipped);
+    return created;
+}
+size_t Graph::CreateWires(std::span<const std::pair<Node*, Node*>> connections, ElbowConfig elbowConfig)
+{
+    return _CreateWires(connections, {}, elbowConfig);
+}
+size_t Graph::CreateWires(std::span<const std::pair<Node*, Node*>> connections, std::span<const ElbowConfig> elbowConfigs)
+{
+    return _CreateWires(connections, elbowConfigs, ElbowConfig(0));
+}
 void Graph::DestroyWire(Wire* wire)
 {
+    EditGroup group(*this);
     _ClearWireReferences(wire);
     _DestroyWire(wire);
 
@@ -387,7 +968,30 @@ void Graph::DestroyWire(Wire* wire)
 void Graph::SwapNodes(Node* a, Node* b)
 {
     Log(LogType::info, "Swapped nodes");
+    Edit edit{ .type = Edit::Type::SwapGates };
+    edit.node = a->m_handle;
+    edit.other = b->m_handle;
+    _Record(edit);
     std::swap(a->m_gate, b->m_gate);
+    _SyncNodeRecord(a);
+    _SyncNodeRecord(b);
+}
+void Graph::SetNodeGate(Node* node, Gate gate, uint8_t extraParam)
+{
+    Edit edit = _NodeEdit(Edit::Type::Retype, node);
+    edit.prevGate = edit.gate;
+    edit.prevExtraParam = edit.extraParam;
+    edit.gate = gate;
+    edit.extraParam = extraParam;
+    _Record(edit);
+
+    node->SetGate(gate);
+    switch (gate)
+    {
+    case Gate::RESISTOR:  node->SetResistance(extraParam); break;
+    case Gate::LED:       node->SetColorIndex(extraParam); break;
+    case Gate::CAPACITOR: node->SetCapacity(extraParam);   break;
+    }
 }
 // Invalidates input wire!
 Wire* Graph::ReverseWire(Wire* wire)
@@ -412,13 +1016,16 @@ Wire* Graph::ReverseWire(Wire* wire)
         exit(1);
     }
 
+    EditGroup group(*this);
+
     // Swap
     Node* tbStart = wire->end;
     Node* tbEnd = wire->start;
-    IVec2 elbow = wire->elbow;
+    // Resolve the config before creating so that history records the final wire
+    Wire reversed(tbStart, tbEnd);
+    reversed.SnapElbowToLegal(wire->elbow);
     DestroyWire(wire);
-    wire = CreateWire(tbStart, tbEnd);
-    wire->SnapElbowToLegal(elbow);
+    wire = CreateWire(tbStart, tbEnd, reversed.elbowConfig);
     orderDirty = true;
     Log(LogType::success, "Wire reversal complete");
     return wire;
@@ -427,37 +1034,214 @@ Wire* Graph::ReverseWire(Wire* wire)
 std::pair<Wire*, Wire*> Graph::BisectWire(Wire* wire, Node* bisector)
 {
     Log(LogType::attempt, "Wire bisection");
+    EditGroup group(*this);
     std::pair<Wire*, Wire*> newWire;
 
-    newWire.first = CreateWire(wire->start, bisector);
-    newWire.first->elbowConfig = wire->elbowConfig;
-    newWire.first->UpdateElbowToLegal();
-
-    newWire.second = CreateWire(bisector, wire->end);
-    newWire.second->elbowConfig = wire->elbowConfig;
-    newWire.second->UpdateElbowToLegal();
+    newWire.first = CreateWire(wire->start, bisector, wire->elbowConfig);
+    newWire.second = CreateWire(bisector, wire->end, wire->elbowConfig);
 
     DestroyWire(wire);
     Log(LogType::success, "Wire bisection complete");
     return newWire;
 }
+void Graph::SnapWireElbowToLegal(Wire* wire, IVec2 pos)
+{
+    ElbowConfig prev = wire->elbowConfig;
+    wire->SnapElbowToLegal(pos);
+    if (wire->elbowConfig != prev)
+    {
+        _UnindexWire(wire, prev);
+        _IndexWire(wire);
+        _SyncWireRecord(wire);
+    }
+}
+
+void Graph::BeginEditGroup()
+{
+    history.BeginGroup();
+}
+void Graph::EndEditGroup()
+{
+    history.EndGroup();
+}
+bool Graph::CanUndo() const
+{
+    return history.CanUndo();
+}
+bool Graph::CanRedo() const
+{
+    return history.CanRedo();
+}
+bool Graph::Undo()
+{
+    if (!history.CanUndo())
+    {
+        Log(LogType::warning, "Nothing to undo");
+        return false;
+    }
+    Log(LogType::attempt, "Undo");
+    EditBatch batch = history.PopUndo();
+    _Replay(batch, true);
+    Log(LogType::success, "Undid {} edits", batch.edits.size());
+    history.PushRedo(std::move(batch));
+    return true;
+}
+bool Graph::Redo()
+{
+    if (!history.CanRedo())
+    {
+        Log(LogType::warning, "Nothing to redo");
+        return false;
+    }
+    Log(LogType::attempt, "Redo");
+    EditBatch batch = history.PopRedo();
+    _Replay(batch, false);
+    Log(LogType::success, "Redid {} edits", batch.edits.size());
+    history.PushUndo(std::move(batch));
+    return true;
+}
+
+void Graph::_RebuildGroupChunks() const
+{
+    groupChunks.clear();
+    groupOrder.clear();
+    for (Group* group : groups)
+    {
+        groupOrder.emplace(group, groupOrder.size());
+        IRect bounds = group->GetBounds();
+        IVec2 minChunk = _NodeChunkOf(IVec2(bounds.x, bounds.y));
+        IVec2 maxChunk = _NodeChunkOf(IVec2(bounds.x + bounds.w - 1, bounds.y + bounds.h - 1));
+        for (int y = minChunk.y; y <= maxChunk.y; ++y)
+        {
+            for (int x = minChunk.x; x <= maxChunk.x; ++x)
+            {
+                groupChunks[IVec2(x, y)].push_back(group);
+            }
+        }
+    }
+    groupChunksDirty = false;
+}
+const std::vector<Group*>* Graph::_GroupChunkAt(IVec2 pos) const
+{
+    if (groupChunksDirty)
+        _RebuildGroupChunks();
+    auto it = groupChunks.find(_NodeChunkOf(pos));
+    return it != groupChunks.end() ? &it->second : nullptr;
+}
+
+void Graph::BeginDrag(const std::vector<Node*>& nodes)
+{
+    if (IsDragging())
+        EndDrag(false);
+    dragMembership.assign(handles.size(), false);
+    for (Node* node : nodes)
+    {
+        if (dragMembership[node->m_handle])
+            continue;
+        dragMembership[node->m_handle] = true;
+        dragNodes.push_back(node);
+    }
+    dragOffset = IVec2::Zero();
+}
+void Graph::SetDragOffset(IVec2 offset)
+{
+    dragOffset = offset;
+}
+IVec2 Graph::GetDragOffset() const
+{
+    return dragOffset;
+}
+bool Graph::IsDragging() const
+{
+    return !dragNodes.empty();
+}
+IVec2 Graph::GetDrawPosition(const Node* node) const
+{
+    return _IsDragged(node) ? node->m_position + dragOffset : node->m_position;
+}
+void Graph::EndDrag(bool commit)
+{
+    EditGroup group(*this);
+    std::vector<Node*> moved;
+    moved.swap(dragNodes);
+    dragMembership.clear();
+    if (commit)
+        _TranslateNodes(moved, dragOffset);
+    dragOffset = IVec2::Zero();
+    EndGroupReshape();
+}
 
 Group* Graph::CreateGroup(IRect rec, Color color)
 {
+    EndGroupReshape();
     Group* group = new Group(rec, color, "Label");
     groups.push_back(group);
+    groupChunksDirty = true;
+    _RecordGroup(Edit::Type::CreateGroup, group);
     Log(LogType::info, "Created group");
     return group;
 }
 void Graph::DestroyGroup(Group* group)
 {
+    EndGroupReshape();
+    _RecordGroup(Edit::Type::DestroyGroup, group);
     FindAndErase_ExpectExisting(groups, group);
+    groupChunksDirty = true;
     delete group;
     Log(LogType::info, "Destroyed group");
 }
+void Graph::MoveGroup(Group* group, IVec2 pos)
+{
+    if (reshapedGroup != group)
+    {
+        EndGroupReshape();
+        reshapedGroup = group;
+        reshapeFrom = group->captureBounds;
+    }
+    group->SetPosition(pos);
+    groupChunksDirty = true;
+}
+void Graph::ResizeGroup(Group* group, IRect captureBounds)
+{
+    if (reshapedGroup != group)
+    {
+        EndGroupReshape();
+        reshapedGroup = group;
+        reshapeFrom = group->captureBounds;
+    }
+    group->SetCaptureBounds(captureBounds);
+    groupChunksDirty = true;
+}
+void Graph::EndGroupReshape()
+{
+    Group* group = std::exchange(reshapedGroup, nullptr);
+    if (!group)
+        return;
+    IRect bounds = group->captureBounds;
+    if (bounds.x == reshapeFrom.x && bounds.y == reshapeFrom.y && bounds.w == reshapeFrom.w && bounds.h == reshapeFrom.h)
+        return;
+    Edit edit{ .type = Edit::Type::ReshapeGroup };
+    edit.groupPosition = (uint32_t)(std::find(groups.begin(), groups.end(), group) - groups.begin());
+    GroupRecord after = { group->captureBounds, group->color, group->label };
+    GroupRecord before = after;
+    before.captureBounds = reshapeFrom;
+    if (!replayingHistory)
+        history.Record(edit, before, after);
+}
+void Graph::CancelGroupReshape()
+{
+    Group* group = std::exchange(reshapedGroup, nullptr);
+    if (!group)
+        return;
+    group->SetCaptureBounds(reshapeFrom);
+    groupChunksDirty = true;
+}
 Group* Graph::FindGroupAtPos(IVec2 pos) const
 {
-    for (Group* group : groups)
+    const std::vector<Group*>* chunk = _GroupChunkAt(pos);
+    if (!chunk)
+        return nullptr;
+    for (Group* group : *chunk)
     {
         if (InBoundingBox(group->labelBounds, pos))
             return group;
@@ -466,7 +1250,10 @@ Group* Graph::FindGroupAtPos(IVec2 pos) const
 }
 GroupCorner Graph::FindGroupCornerAtPos(IVec2 pos) const
 {
-    for (Group* g : groups)
+    const std::vector<Group*>* chunk = _GroupChunkAt(pos);
+    if (!chunk)
+        return { nullptr, 0 };
+    for (Group* g : *chunk)
     {
         if (!InBoundingBox(g->GetCaptureBounds(), pos))
             continue;
@@ -646,99 +1433,551 @@ void Graph::EvaluateNode(Node* node)
         break;
 
     default:
-        Log(LogType::error,
-            "Missing eval specialization for encountered node; node type is " +
-            std::to_string((int)node->m_gate) +
-            TextFormat(" (\'%c\')", (char)node->m_gate));
+        Log(LogType::error, "Missing eval specialization for encountered node; node type is {} ('{}')",
+            (int)node->m_gate, std::string(1, (char)node->m_gate));
         exit(1);
         break;
     }
-}
+}
+
+bool Graph::Evaluate()
+{
+    if (orderDirty)
+    {
+        Sort();
+        orderDirty = false;
+    }
+
+    // Capacitor charge and delay memory carry into the next tick just like state does
+    auto memoryOf = [](const Node* node) -> uint8_t
+    {
+        switch (node->m_gate)
+        {
+        case Gate::CAPACITOR: return node->m_ntd.c.charge;
+        case Gate::DELAY:     return node->m_ntd.d.lastState;
+        default:              return 0;
+        }
+    };
+
+    bool changed = false;
+    for (Node* node : nodes)
+    {
+        uint8_t memory = memoryOf(node);
+        EvaluateNode(node);
+        if (memory != memoryOf(node)) [[unlikely]]
+            changed = true;
+        if (node->m_state != densityActive[node->m_handle]) [[unlikely]]
+        {
+            changed = true;
+            densityActive[node->m_handle] = node->m_state;
+            _CountDensity(_NodeChunkOf(node->m_collisionPosition), 0, node->m_state ? 1 : -1);
+            if (!renderChunks.empty())
+                _RenderStateFlip(node);
+        }
+    }
+    return changed;
+}
+
+IRect Graph::_VisibleBounds() const
+{
+    // Nodes and wire ends poke half a grid out from their positions
+    return ExpandIRect(owningTab->GetViewBounds(), g_gridSize);
+}
+void Graph::_DrawDensityTiles(Color colorActive, Color colorInactive) const
+{
+    float zoom = owningTab->camera.zoom;
+    int level = 0;
+    while (level + 1 < g_densityLevels && (float)(g_nodeChunkSize << level) * zoom < (float)g_densityTilePixels)
+    {
+        ++level;
+    }
+    const int tileSize = g_nodeChunkSize << level;
+    // How many nodes fit in a tile if every grid cell had one
+    const float capacity = (float)(tileSize / g_gridSize) * (float)(tileSize / g_gridSize);
+
+    IRect view = _VisibleBounds();
+    auto tileOf = [tileSize](int x) { return (x >= 0 ? x : x - (tileSize - 1)) / tileSize; };
+    IVec2 minTile(tileOf(view.x), tileOf(view.y));
+    IVec2 maxTile(tileOf(view.x + view.w - 1), tileOf(view.y + view.h - 1));
+    _VisitTiles(densityTiles[level], minTile, maxTile, [&](IVec2 tilePos, const DensityTile& tile)
+    {
+        // Boards are sparse even where they're busy, so fill is exaggerated to stay visible
+        float fill = std::min(1.0f, (float)tile.nodes / capacity * 8.0f);
+        float activeRatio = (float)tile.active / (float)tile.nodes;
+        Color color = {
+            (uint8_t)(colorInactive.r + (colorActive.r - colorInactive.r) * activeRatio),
+            (uint8_t)(colorInactive.g + (colorActive.g - colorInactive.g) * activeRatio),
+            (uint8_t)(colorInactive.b + (colorActive.b - colorInactive.b) * activeRatio),
+            (uint8_t)(255.0f * (0.25f + 0.75f * fill)),
+        };
+        DrawRectangle(tilePos.x * tileSize, tilePos.y * tileSize, tileSize, tileSize, color);
+    });
+}
+bool Graph::_UseRenderChunks() const
+{
+    // Past 1:1 a chunk would need a texture larger than the screen, and the view only ever shows a few nodes anyway
+    float zoom = owningTab->camera.zoom;
+    return !IsDragging() && zoom >= g_densityZoom && zoom <= 1.0f;
+}
+void Graph::_InvalidateNodeLayers(IVec2 nodeChunk)
+{
+    if (renderChunks.empty()) [[likely]]
+        return;
+    _VisitRenderChunksAround(nodeChunk, [](RenderChunk& chunk)
+    {
+        chunk.nodesDirty = true;
+        chunk.flippedNodes.clear();
+        chunk.capacitors.clear();
+    });
+}
+void Graph::_InvalidateWireLayers(const std::vector<IVec2>& nodeChunks)
+{
+    if (renderChunks.empty()) [[likely]]
+        return;
+    for (IVec2 nodeChunk : nodeChunks)
+    {
+        _VisitRenderChunksAround(nodeChunk, [](RenderChunk& chunk)
+        {
+            chunk.wiresDirty = true;
+            chunk.hotWires.clear();
+        });
+    }
+}
+void Graph::_RenderStateFlip(Node* node)
+{
+    // Past this many, redrawing the layer is cheaper than drawing them all every frame
+    constexpr size_t maxFlippedNodes = 64;
+    _VisitRenderChunksAround(_NodeChunkOf(node->m_collisionPosition), [node](RenderChunk& chunk)
+    {
+        if (chunk.nodesDirty)
+            return;
+        chunk.flippedNodes.insert(node);
+        if (chunk.flippedNodes.size() > maxFlippedNodes)
+            chunk.nodesDirty = true;
+    });
+
+    thread_local std::vector<IVec2> chunks;
+    for (Wire* wire : node->m_wires)
+    {
+        if (wire->start != node)
+            continue;
+        _WireChunksOf(chunks, wire->start->m_collisionPosition, wire->end->m_collisionPosition, wire->elbowConfig);
+        for (IVec2 nodeChunk : chunks)
+        {
+            _VisitRenderChunksAround(nodeChunk, [node](RenderChunk& chunk)
+            {
+                // Drawn once more without them; from then on they're drawn live
+                if (chunk.hotWires.insert(node).second)
+                    chunk.wiresDirty = true;
+            });
+        }
+    }
+}
+void Graph::_ClearRenderChunks() const
+{
+    for (auto& [pos, chunk] : renderChunks)
+    {
+        if (chunk.wireLayer.id)
+            UnloadRenderTexture(chunk.wireLayer);
+        if (chunk.nodeLayer.id)
+            UnloadRenderTexture(chunk.nodeLayer);
+    }
+    renderChunks.clear();
+}
+void Graph::_DrawNode(const Node* node, float zoom, Color colorActive, Color colorInactive, bool ledsLit) const
+{
+    constexpr int nodeRadius = (int)Node::g_nodeRadius;
+    if (node->GetGate() == Gate::LED && ledsLit) [[unlikely]]
+    {
+        if (node->GetState())
+        {
+            DrawRectangle(
+                node->GetX() - nodeRadius - 1,
+                node->GetY() - nodeRadius - 1,
+                nodeRadius * 2 + 2,
+                nodeRadius * 2 + 2,
+                Node::g_resistanceBands[node->GetColorIndex()]
+            );
+        }
+        else
+        {
+            DrawRectangle(
+                node->GetX() - nodeRadius - 1,
+                node->GetY() - nodeRadius - 1,
+                nodeRadius * 2 + 2,
+                nodeRadius * 2 + 2,
+                BLACK
+            );
+        }
+    }
+    else [[likely]]
+        node->Draw(zoom, node->GetState() ? colorActive : colorInactive, UIColor(UIColorID::UI_COLOR_BACKGROUND), colorInactive);
+}
+// Targets the render texture of the chunk at renderPos with a camera whose origin is the chunk's corner
+static void BeginRenderChunk(const RenderTexture2D& layer, IVec2 renderPos, int chunkSize, float zoom)
+{
+    BeginTextureMode(layer);
+    ClearBackground(BLANK);
+    Camera2D camera = {};
+    camera.target = { (float)(renderPos.x * chunkSize), (float)(renderPos.y * chunkSize) };
+    camera.zoom = zoom;
+    BeginMode2D(camera);
+}
+static void EndRenderChunk()
+{
+    EndMode2D();
+    EndTextureMode();
+}
+void Graph::_RasterizeWireLayer(IVec2 renderPos, RenderChunk& chunk, Color colorActive, Color colorInactive) const
+{
+    // Wires just outside still poke in
+    IVec2 minChunk = renderPos * 4 - IVec2(1);
+    IVec2 maxChunk = renderPos * 4 + IVec2(4);
+    thread_local std::vector<Wire*> chunkWires;
+    chunkWires.clear();
+    _VisitChunks(wireChunks, minChunk, maxChunk, [&](const std::vector<Wire*>& bucket)
+    {
+        chunkWires.insert(chunkWires.end(), bucket.begin(), bucket.end());
+    });
+    std::sort(chunkWires.begin(), chunkWires.end());
+    chunkWires.erase(std::unique(chunkWires.begin(), chunkWires.end()), chunkWires.end());
+
+    BeginRenderChunk(chunk.wireLayer, renderPos, g_renderChunkSize, renderChunkZoom);
+    for (Wire* wire : chunkWires)
+    {
+        if (!chunk.hotWires.contains(wire->start))
+            wire->Draw(wire->start->GetState() ? colorActive : colorInactive);
+    }
+    EndRenderChunk();
+    chunk.wiresDirty = false;
+}
+void Graph::_RasterizeNodeLayer(IVec2 renderPos, RenderChunk& chunk, float zoom, Color colorActive, Color colorInactive, bool ledsLit) const
+{
+    IVec2 minChunk = renderPos * 4 - IVec2(1);
+    IVec2 maxChunk = renderPos * 4 + IVec2(4);
+    chunk.flippedNodes.clear();
+    chunk.capacitors.clear();
+    BeginRenderChunk(chunk.nodeLayer, renderPos, g_renderChunkSize, renderChunkZoom);
+    _VisitChunks(nodeChunks, minChunk, maxChunk, [&](const std::vector<Node*>& bucket)
+    {
+        for (Node* node : bucket)
+        {
+            if (node->GetGate() == Gate::CAPACITOR) [[unlikely]]
+                chunk.capacitors.push_back(node);
+            else
+                _DrawNode(node, zoom, colorActive, colorInactive, ledsLit);
+        }
+    });
+    EndRenderChunk();
+    chunk.nodesDirty = false;
+}
+void Graph::_VisibleRenderChunks(std::vector<std::pair<IVec2, RenderChunk*>>& result) const
+{
+    float zoom = owningTab->camera.zoom;
+    if (zoom != renderChunkZoom)
+    {
+        _ClearRenderChunks();
+        renderChunkZoom = zoom;
+    }
+
+    IRect view = _VisibleBounds();
+    auto renderChunkOf = [](int x) { return (x >= 0 ? x : x - (g_renderChunkSize - 1)) / g_renderChunkSize; };
+    IVec2 minChunk(renderChunkOf(view.x), renderChunkOf(view.y));
+    IVec2 maxChunk(renderChunkOf(view.x + view.w - 1), renderChunkOf(view.y + view.h - 1));
+    const int pixels = (int)std::ceil((float)g_renderChunkSize * zoom);
+
+    result.clear();
+    for (int y = minChunk.y; y <= maxChunk.y; ++y)
+    {
+        for (int x = minChunk.x; x <= maxChunk.x; ++x)
+        {
+            RenderChunk& chunk = renderChunks[IVec2(x, y)];
+            if (!chunk.wireLayer.id)
+            {
+                chunk.wireLayer = LoadRenderTexture(pixels, pixels);
+                chunk.nodeLayer = LoadRenderTexture(pixels, pixels);
+            }
+            chunk.lastDrawn = renderFrame;
+            result.emplace_back(IVec2(x, y), &chunk);
+        }
+    }
+}
+void Graph::_DrawRenderLayer(IVec2 renderPos, const RenderTexture2D& layer) const
+{
+    // Render textures are stored upside down
+    Rectangle source = { 0, 0, (float)layer.texture.width, -(float)layer.texture.height };
+    Rectangle dest = { (float)(renderPos.x * g_renderChunkSize), (float)(renderPos.y * g_renderChunkSize), (float)g_renderChunkSize, (float)g_renderChunkSize };
+    DrawTexturePro(layer.texture, source, dest, { 0,0 }, 0.0f, WHITE);
+}
+void Graph::DrawWires(Color colorActive, Color colorInactive) const
+{
+    ++renderFrame;
+    bool dragging = IsDragging();
+
+    if (_UseRenderChunks())
+    {
+        thread_local std::vector<std::pair<IVec2, RenderChunk*>> visibleChunks;
+        _VisibleRenderChunks(visibleChunks);
+        if (ColorToInt(colorActive) != ColorToInt(renderChunkWireColors[0]) || ColorToInt(colorInactive) != ColorToInt(renderChunkWireColors[1]))
+        {
+            renderChunkWireColors[0] = colorActive;
+            renderChunkWireColors[1] = colorInactive;
+            for (auto& [pos, chunk] : renderChunks)
+            {
+                chunk.wiresDirty = true;
+            }
+        }
+
+        bool rasterized = false;
+        for (auto [pos, chunk] : visibleChunks)
+        {
+            if (chunk->wiresDirty)
+            {
+                _RasterizeWireLayer(pos, *chunk, colorActive, colorInactive);
+                rasterized = true;
+            }
+        }
+        if (rasterized)
+            owningTab->SetDrawOffset(IVec2::Zero()); // Texture mode drops the camera
+
+        thread_local std::vector<Wire*> hot;
+        hot.clear();
+        for (auto [pos, chunk] : visibleChunks)
+        {
+            _DrawRenderLayer(pos, chunk->wireLayer);
+            for (Node* node : chunk->hotWires)
+            {
+                for (Wire* wire : node->GetOutputs())
+                {
+                    hot.push_back(wire);
+                }
+            }
+        }
+        std::sort(hot.begin(), hot.end());
+        hot.erase(std::unique(hot.begin(), hot.end()), hot.end());
+        for (Wire* wire : hot)
+        {
+            wire->Draw(wire->start->GetState() ? colorActive : colorInactive);
+        }
+        return;
+    }
+
+    // Wires crossing several visible chunks are in each of their buckets
+    thread_local std::vector<Wire*> visible;
+    visible.clear();
+    if (owningTab->camera.zoom >= g_densityZoom) // Zoomed out, the density tiles stand in for wires
+    {
+        IRect view = _VisibleBounds();
+        _VisitChunks(wireChunks, _NodeChunkOf(view.xy), _NodeChunkOf(view.xy + view.wh - IVec2(1)), [&](const std::vector<Wire*>& chunk)
+        {
+            visible.insert(visible.end(), chunk.begin(), chunk.end());
+        });
+    }
+    std::sort(visible.begin(), visible.end());
+    visible.erase(std::unique(visible.begin(), visible.end()), visible.end());
 
-void Graph::Evaluate()
-{
-    if (orderDirty)
+    for (Wire* wire : visible)
     {
-        Sort();
-        orderDirty = false;
+        // Wires touching the drag are indexed where they were, not where they're drawn
+        if (dragging && (_IsDragged(wire->start) || _IsDragged(wire->end))) [[unlikely]]
+            continue;
+        wire->Draw(wire->start->GetState() ? colorActive : colorInactive);
     }
 
-    for (Node* node : nodes)
+    if (!dragging) [[likely]]
+        return;
+
+    // Only the wires crossing the edge of the drag stretch
+    for (Node* node : dragNodes)
     {
-        EvaluateNode(node);
+        for (Wire* wire : node->GetWires())
+        {
+            Node* other = wire->start == node ? wire->end : wire->start;
+            if (_IsDragged(other))
+                continue;
+            IVec2 start = GetDrawPosition(wire->start);
+            IVec2 end = GetDrawPosition(wire->end);
+            Wire::Draw(start, Wire::GetLegalElbowPosition(start, end, wire->elbowConfig), end, wire->start->GetState() ? colorActive : colorInactive);
+        }
     }
-}
-
-void Graph::DrawWires(Color colorActive, Color colorInactive) const
-{
-    for (Wire* wire : wires)
+    owningTab->SetDrawOffset(dragOffset);
+    for (Node* node : dragNodes)
     {
-        wire->Draw(wire->start->GetState() ? colorActive : colorInactive);
+        for (Wire* wire : node->GetOutputs())
+        {
+            if (_IsDragged(wire->end))
+                wire->Draw(wire->start->GetState() ? colorActive : colorInactive);
+        }
     }
+    owningTab->SetDrawOffset(IVec2::Zero());
 }
 void Graph::DrawNodes(float zoom, Color colorActive, Color colorInactive) const
 {
-    constexpr int nodeRadius = (int)Node::g_nodeRadius;
-    for (Node* node : nodes)
+    bool dragging = IsDragging();
+    bool ledsLit = owningTab->owningWindow->GetBaseMode() == Mode::INTERACT;
+    IRect view = _VisibleBounds();
+
+    auto drawNode = [&](const Node* node)
+    {
+        _DrawNode(node, zoom, colorActive, colorInactive, ledsLit);
+    };
+
+    BeginNodeIconBatch();
+
+    if (_UseRenderChunks())
     {
-        if (node->GetGate() == Gate::LED && owningTab->owningWindow->GetBaseMode() == Mode::INTERACT) [[unlikely]]
+        thread_local std::vector<std::pair<IVec2, RenderChunk*>> visibleChunks;
+        _VisibleRenderChunks(visibleChunks);
+        if (ColorToInt(colorActive) != ColorToInt(renderChunkNodeColors[0]) || ColorToInt(colorInactive) != ColorToInt(renderChunkNodeColors[1]) || ledsLit != renderChunkLedsLit)
         {
-            if (node->GetState())
+            renderChunkNodeColors[0] = colorActive;
+            renderChunkNodeColors[1] = colorInactive;
+            renderChunkLedsLit = ledsLit;
+            for (auto& [pos, chunk] : renderChunks)
             {
-                DrawRectangle(
-                    node->GetX() - nodeRadius - 1,
-                    node->GetY() - nodeRadius - 1,
-                    nodeRadius * 2 + 2,
-                    nodeRadius * 2 + 2,
-                    Node::g_resistanceBands[node->GetColorIndex()]
-                );
+                chunk.nodesDirty = true;
             }
-            else
+        }
+
+        bool rasterized = false;
+        for (auto [pos, chunk] : visibleChunks)
+        {
+            if (chunk->nodesDirty)
+            {
+                _RasterizeNodeLayer(pos, *chunk, zoom, colorActive, colorInactive, ledsLit);
+                rasterized = true;
+            }
+        }
+        if (rasterized)
+            owningTab->SetDrawOffset(IVec2::Zero()); // Texture mode drops the camera
+
+        // Neighbouring chunks share the nodes along their edges
+        thread_local std::vector<const Node*> live;
+        live.clear();
+        for (auto [pos, chunk] : visibleChunks)
+        {
+            _DrawRenderLayer(pos, chunk->nodeLayer);
+            live.insert(live.end(), chunk->flippedNodes.begin(), chunk->flippedNodes.end());
+            live.insert(live.end(), chunk->capacitors.begin(), chunk->capacitors.end());
+        }
+        std::sort(live.begin(), live.end());
+        live.erase(std::unique(live.begin(), live.end()), live.end());
+        for (const Node* node : live)
+        {
+            if (InBoundingBox(view, node->GetPosition()))
+                drawNode(node);
+        }
+
+        // Keep what's on screen and a few screens' worth around it
+        if (renderChunks.size() > g_maxRenderChunks)
+        {
+            for (auto it = renderChunks.begin(); it != renderChunks.end();)
+            {
+                if (it->second.lastDrawn == renderFrame)
+                {
+                    ++it;
+                    continue;
+                }
+                UnloadRenderTexture(it->second.wireLayer);
+                UnloadRenderTexture(it->second.nodeLayer);
+                it = renderChunks.erase(it);
+            }
+        }
+    }
+    else if (owningTab->camera.zoom < g_densityZoom)
+    {
+        // Dragged nodes are still counted where they were picked up; close enough at this distance
+        _DrawDensityTiles(colorActive, colorInactive);
+    }
+    else
+    {
+        _VisitChunks(nodeChunks, _NodeChunkOf(view.xy), _NodeChunkOf(view.xy + view.wh - IVec2(1)), [&](const std::vector<Node*>& chunk)
+        {
+            for (const Node* node : chunk)
             {
-                DrawRectangle(
-                    node->GetX() - nodeRadius - 1,
-                    node->GetY() - nodeRadius - 1,
-                    nodeRadius * 2 + 2,
-                    nodeRadius * 2 + 2,
-                    BLACK
-                );
+                if (dragging && _IsDragged(node)) [[unlikely]]
+                    continue;
+                if (InBoundingBox(view, node->GetPosition()))
+                    drawNode(node);
             }
+        });
+    }
+
+    // Dragged nodes go on top
+    if (dragging)
+    {
+        owningTab->SetDrawOffset(dragOffset);
+        for (const Node* node : dragNodes)
+        {
+            if (InBoundingBox(view, node->GetPosition() + dragOffset))
+                drawNode(node);
         }
-        else [[likely]]
-            node->Draw(zoom, node->GetState() ? colorActive : colorInactive, UIColor(UIColorID::UI_COLOR_BACKGROUND), colorInactive);
+        owningTab->SetDrawOffset(IVec2::Zero());
     }
+
+    EndNodeIconBatch();
 }
 void Graph::DrawGroups() const
 {
-    for (Group* group : groups)
-    {
-        group->Draw();
+    if (groupChunksDirty)
+        _RebuildGroupChunks();
+
+    IRect view = _VisibleBounds();
+    thread_local std::vector<Group*> visible;
+    visible.clear();
+    _VisitChunks(groupChunks, _NodeChunkOf(view.xy), _NodeChunkOf(view.xy + view.wh - IVec2(1)), [&](const std::vector<Group*>& chunk)
+    {
+        visible.insert(visible.end(), chunk.begin(), chunk.end());
+    });
+    // Later groups are drawn over earlier ones
+    std::sort(visible.begin(), visible.end(), [this](const Group* a, const Group* b) { return groupOrder.at(a) < groupOrder.at(b); });
+    visible.erase(std::unique(visible.begin(), visible.end()), visible.end());
+
+    for (const Group* group : visible)
+    {
+        IRect bounds = group->GetBounds();
+        if (bounds.x < view.x + view.w && view.x < bounds.x + bounds.w &&
+            bounds.y < view.y + view.h && view.y < bounds.y + bounds.h)
+            group->Draw();
     }
 }
 
 Node* Graph::FindNodeAtPos(IVec2 pos) const
 {
-    for (Node* node : nodes)
+    auto it = nodeChunks.find(_NodeChunkOf(pos));
+    if (it == nodeChunks.end())
+        return nullptr;
+    for (Node* node : it->second)
     {
-        if (node->GetPosition() == pos)
+        if (node->m_collisionPosition == pos)
             return node;
     }
     return nullptr;
 }
 Wire* Graph::FindWireAtPos(IVec2 pos) const
 {
-    for (Wire* wire : wires)
+    auto it = wireChunks.find(_NodeChunkOf(pos));
+    if (it == wireChunks.end())
+        return nullptr;
+    for (Wire* wire : it->second)
     {
-        if (CheckCollisionIVecPointWire(pos, wire))
+        IVec2 start = wire->start->m_collisionPosition;
+        IVec2 end = wire->end->m_collisionPosition;
+        IVec2 elbow = Wire::GetLegalElbowPosition(start, end, wire->elbowConfig);
+        if (CheckCollisionIVecPointLine(pos, start, elbow) || CheckCollisionIVecPointLine(pos, elbow, end))
             return wire;
     }
     return nullptr;
 }
 Wire* Graph::FindWireElbowAtPos(IVec2 pos) const
 {
-    for (Wire* wire : wires)
+    // The elbow is on the wire's path, so the wire is bucketed wherever its elbow is
+    auto it = wireChunks.find(_NodeChunkOf(pos));
+    if (it == wireChunks.end())
+        return nullptr;
+    for (Wire* wire : it->second)
     {
-        if (wire->elbow == pos)
+        if (Wire::GetLegalElbowPosition(wire->start->m_collisionPosition, wire->end->m_collisionPosition, wire->elbowConfig) == pos)
             return wire;
     }
     return nullptr;
@@ -746,16 +1985,7 @@ Wire* Graph::FindWireElbowAtPos(IVec2 pos) const
 
 void Graph::FindNodesInRect(std::vector<Node*>& result, IRect rec) const
 {
-    // Exclusive bounds
-    IRect bounds = ShrinkIRect(rec);
-    auto pred = [&bounds](Node* node) { return InBoundingBox(bounds, node->GetPosition()); };
-    size_t countInRect = std::count_if(nodes.begin(), nodes.end(), pred);
-    result.reserve(result.size() + countInRect);
-    for (Node* node : nodes)
-    {
-        if (InBoundingBox(bounds, node->GetPosition()))
-            result.push_back(node);
-    }
+    FindNodesInMultiRect(result, { rec });
 }
 void Graph::FindNodesInMultiRect(std::vector<Node*>& result, const std::vector<IRect>& rec) const
 {
@@ -764,341 +1994,451 @@ void Graph::FindNodesInMultiRect(std::vector<Node*>& result, const std::vector<I
     bounds.reserve(rec.size());
     for (const IRect& bound : rec)
     {
-        bounds.push_back(ShrinkIRect(bound));
+        IRect shrunk = ShrinkIRect(bound);
+        if (shrunk.w > 0 && shrunk.h > 0)
+            bounds.push_back(shrunk);
     }
 
-    size_t countInRect = 0;
-    for (Node* node : nodes)
-    {
-        for (const IRect& bound : bounds)
-        {
-            if (InBoundingBox(bound, node->GetPosition()))
-            {
-                ++countInRect;
-                break;
-            }
-        }
-    }
-    result.reserve(result.size() + countInRect);
-    for (Node* node : nodes)
+    for (size_t i = 0; i < bounds.size(); ++i)
     {
-        for (const IRect& bound : bounds)
+        // A node in several overlapping rects belongs to the first one that has it
+        auto collect = [&](const std::vector<Node*>& chunk)
         {
-            if (InBoundingBox(bound, node->GetPosition()))
+            for (Node* node : chunk)
             {
-                result.push_back(node);
-                break;
+                if (!InBoundingBox(bounds[i], node->m_collisionPosition))
+                    continue;
+                bool claimed = false;
+                for (size_t j = 0; j < i && !claimed; ++j)
+                {
+                    claimed = InBoundingBox(bounds[j], node->m_collisionPosition);
+                }
+                if (!claimed)
+                    result.push_back(node);
             }
-        }
+        };
+
+        _VisitChunks(nodeChunks, _NodeChunkOf(bounds[i].xy), _NodeChunkOf(bounds[i].xy + bounds[i].wh - IVec2(1)), collect);
     }
 }
 
 
-void Graph::StoreBlueprint(Blueprint* bp)
+void Graph::SpawnBlueprint(Blueprint* bp, IVec2 topLeft)
 {
-    Blueprint* copy = new Blueprint(*bp);
+    Log(LogType::attempt, LogCategory::blueprints, "Spawning blueprint {}", bp->name);
+    bp->LoadBody();
+    EditGroup group(*this);
 
-    // Ensure unique name
+    std::vector<Node*> spawned;
+    spawned.reserve(bp->nodes.size());
+    for (const NodeBP& node_bp : bp->nodes)
     {
-        bool exists = false;
-        for (Blueprint* existing : blueprints)
-        {
-            if (existing->name == copy->name)
-            {
-                exists = true;
-                break;
-            }
-        }
-        if (exists)
+        spawned.push_back(_AllocNode(Node(node_bp.name.c_str(), node_bp.relativePosition + topLeft, node_bp.gate, node_bp.extraParam)));
+    }
+    _InsertNodes(spawned);
+
+    std::vector<std::pair<Node*, Node*>> connections;
+    std::vector<ElbowConfig> elbowConfigs;
+    connections.reserve(bp->wires.size());
+    elbowConfigs.reserve(bp->wires.size());
+    for (const WireBP& wire_bp : bp->wires)
+    {
+        if (wire_bp.startNodeIndex >= spawned.size() || wire_bp.endNodeIndex >= spawned.size())
         {
-            std::regex matchPattern(copy->name + " \\([0-9]+\\)");
-            auto countRule = [&matchPattern](Blueprint* existing)
-            {
-                return std::regex_match(existing->name, matchPattern);
-            };
-            size_t matching = 1 + std::count_if(blueprints.begin(), blueprints.end(), countRule);
-            copy->name.append(" (" + std::to_string(matching) + ")");
+            Log(LogType::error, "Malformed node ID in blueprint");
+            exit(1);
         }
+        connections.emplace_back(spawned[wire_bp.startNodeIndex], spawned[wire_bp.endNodeIndex]);
+        elbowConfigs.push_back(wire_bp.elbowConfig);
     }
-
-    blueprints.push_back(copy);
-    Log(LogType::success, "Stored blueprint " + copy->name);
+    CreateWires(connections, elbowConfigs);
+    Log(LogType::success, LogCategory::blueprints, "Spawned blueprint {}", bp->name);
 }
-void Graph::SpawnBlueprint(Blueprint* bp, IVec2 topLeft)
+
+GraphSnapshot Graph::TakeSnapshot() const
 {
-    Log(LogType::attempt, "Spawning blueprint " + bp->name);
-    std::unordered_map<size_t, Node*> nodeID;
-    nodes.reserve(nodes.size() + bp->nodes.size());
-    for (size_t i = 0; i < bp->nodes.size(); ++i)
+    GraphSnapshot snapshot;
+    snapshot.nodes = nodeRecords;
+    snapshot.wires = wireRecords;
+    snapshot.groups.reserve(groups.size());
+    for (const Group* group : groups)
     {
-        Node* node = _CreateNode(Node(bp->nodes[i].name.c_str(), bp->nodes[i].relativePosition + topLeft, bp->nodes[i].gate, bp->nodes[i].extraParam));
-        nodeID.emplace(i, node);
+        snapshot.groups.push_back({ group->captureBounds, group->color, group->label });
     }
-    wires.reserve(wires.size() + bp->wires.size());
-    for (const WireBP& wire_bp : bp->wires)
+    return snapshot;
+}
+
+bool Graph::Save(const std::string& filename) const
+{
+    Log(LogType::attempt, "Saving file {}", filename);
+    if (!TakeSnapshot().Save(filename, owningTab->owningWindow->compressFiles))
     {
-        Node* start;
-        {
-            auto it = nodeID.find(wire_bp.startNodeIndex);
-            if (it == nodeID.end())
-            {
-                Log(LogType::error, "Malformed node ID in blueprint");
-                exit(1);
-            }
-            start = it->second;
-        }
-        Node* end;
-        {
-            auto it = nodeID.find(wire_bp.endNodeIndex);
-            if (it == nodeID.end())
-            {
-                Log(LogType::error, "Malformed node ID in blueprint");
-                exit(1);
-            }
-            end = it->second;
-        }
-        Wire* wire = CreateWire(start, end, wire_bp.elbowConfig);
+        Log(LogType::warning, "Couldn't write {}", filename);
+        return false;
     }
-    Log(LogType::success, "Spawned blueprint " + bp->name);
+    Log(LogType::success, "Save complete");
+    return true;
 }
 
-const std::vector<Blueprint*>& Graph::GetBlueprints() const
+void Graph::_UnloadForLoad()
 {
-    return blueprints;
+    // Replaced wholesale, so none of this is an edit; _FinishLoad rebuilds the indexes and clears the history
+    for (Node* node : nodes)
+    {
+        delete node;
+    }
+    for (Wire* wire : wires)
+    {
+        delete wire;
+    }
+    for (Group* group : groups)
+    {
+        delete group;
+    }
+    nodes.clear();
+    startNodes.clear();
+    wires.clear();
+    groups.clear();
+    groupChunksDirty = true;
+    dragNodes.clear();
+    dragMembership.clear();
+    dragOffset = IVec2::Zero();
 }
 
-void Graph::Save(const std::string& filename) const
+void Graph::_FinishLoad()
 {
-    Log(LogType::attempt, "Saving file " + filename);
-    auto prepNodeIDs = [](std::unordered_map<Node*, size_t>& nodeIDs, const std::vector<Node*>& nodes)
+    for (Wire* wire : wires)
     {
-        nodeIDs.reserve(nodes.size());
-        for (size_t i = 0; i < nodes.size(); ++i)
-        {
-            nodeIDs.insert({ nodes[i], i });
-        }
-    };
+        wire->start->AddWireOutput(wire);
+        wire->end->AddWireInput(wire);
+        wire->UpdateElbowToLegal();
+    }
 
-    auto prepWireIDs = [](std::unordered_map<Wire*, size_t>& wireIDs, const std::vector<Wire*>& wires)
+    // Nothing in the old history refers to the new handles, so it goes before any are handed out
+    history.Clear();
+    handles.clear();
+    handles.reserve(nodes.size());
+    freeHandles.clear();
+    handleSweepAt = g_minHandleSweep;
+    nodeRecords.Clear();
+    nodeChunks.clear();
+    for (auto& level : densityTiles)
+    {
+        level.clear();
+    }
+    densityActive.clear();
+    _ClearRenderChunks();
+    for (Node* node : nodes)
     {
-        wireIDs.reserve(wires.size());
-        for (size_t i = 0; i < wires.size(); ++i)
-        {
-            wireIDs.insert({ wires[i], i });
-        }
-    };
-
-    std::ofstream file(filename, std::fstream::out | std::fstream::trunc);
+        _AssignHandle(node);
+        _IndexNode(node);
+    }
+    wireRecords.Clear();
+    freeWireRecords.clear();
+    wireChunks.clear();
+    for (Wire* wire : wires)
     {
-        file << "1.3\n";
+        _IndexWire(wire);
+        _AcquireWireRecord(wire);
+    }
+    reshapedGroup = nullptr;
 
-        std::unordered_map<Node*, size_t> nodeIDs;
-        std::unordered_map<Wire*, size_t> wireIDs;
-        std::thread a(prepNodeIDs, std::ref(nodeIDs), std::cref(nodes));
-        std::thread b(prepWireIDs, std::ref(wireIDs), std::cref(wires));
-        a.join();
-        b.join();
+    orderDirty = true;
+}
 
-        // Nodes
-        file << TextFormat("n %i\n", nodes.size());
-        for (Node* node : nodes)
-        {
-            file << TextFormat("%c %i %i", (char)node->m_gate, node->GetX(), node->GetY());
-            if (node->GetGate() == Gate::RESISTOR)
-                file << TextFormat(" %i", node->GetResistance());
-            else if (node->GetGate() == Gate::LED)
-                file << TextFormat(" %i", node->GetColorIndex());
-            else if (node->GetGate() == Gate::CAPACITOR)
-                file << TextFormat(" %i", node->GetCapacity());
-            if (node->HasName())
-            {
-                file << ' ' << node->GetName();
-                Log(LogType::info, "Stored named node " + node->GetName());
-            }
-            file << '\n';
-        }
+void Graph::Load(const std::string& filename)
+{
+    Log(LogType::success, "Loading file {}", filename);
+    journal.Close();
 
-        // Wires
-        file << TextFormat("w %i\n", wires.size());
-        for (Wire* wire : wires)
-        {
-            file << TextFormat("%i %i %i\n", wire->elbowConfig, nodeIDs.find(wire->start)->second, nodeIDs.find(wire->end)->second);
-        }
+    if (cgb::IsBinaryFilename(filename))
+        _LoadBinary(filename);
+    else
+        _LoadText(filename);
 
-        // Groups
-        file << TextFormat("g %i\n", groups.size());
-        for (Group* group : groups)
-        {
-            file << TextFormat("%i %i %i %i %i %i %i %i %s\n",
-                group->captureBounds.x, group->captureBounds.y, group->captureBounds.w, group->captureBounds.h,
-                (int)group->color.r, (int)group->color.g, (int)group->color.b, (int)group->color.a,
-                group->label.c_str());
-        }
-    }
-    file.close();
-    Log(LogType::success, "Save complete");
+    Log(LogType::success, "Load complete");
 }
 
-void Graph::Load(const std::string& filename)
+void Graph::_LoadBinary(const std::string& filename)
 {
-    Log(LogType::success, "Loading file " + filename);
+    MappedFile file(filename);
+    std::string unpacked;
+    cgb::View view;
+    if (!file.IsOpen() || !view.Open(file, unpacked))
+    {
+        Log(LogType::warning, "Couldn't read {} as a binary graph", filename);
+        return;
+    }
 
-    // HACK: Does not conform to standard _CreateNode/Wire functions!!
-    auto allocNodes = [](std::vector<Node*>& nodes, size_t nodeCount)
+    _UnloadForLoad();
+
+    // Records are read in place from the mapped file (or its decompressed copy); the only work per record is constructing the element
+    nodes.resize(view.nodes.size());
+    ParallelFor(view.nodes.size(), [&](size_t begin, size_t end)
     {
-        nodes.reserve(nodeCount);
-        for (size_t i = 0; i < nodeCount; ++i)
+        for (size_t i = begin; i < end; ++i)
         {
-            nodes.push_back(new Node);
+            const cgb::NodeRecord& record = view.nodes[i];
+            Node* node = new Node(IVec2(record.x, record.y), (Gate)record.gate, record.extraParam);
+            if (record.name.length)
+                node->m_name = view.String(record.name);
+            nodes[i] = node;
         }
-    };
-
-    auto allocWires = [](std::vector<Wire*>& wires, size_t wireCount)
+    });
+    wires.resize(view.wires.size());
+    ParallelFor(view.wires.size(), [&](size_t begin, size_t end)
     {
-        wires.reserve(wireCount);
-        for (size_t i = 0; i < wireCount; ++i)
+        for (size_t i = begin; i < end; ++i)
         {
-            wires.push_back(new Wire);
+            const cgb::WireRecord& record = view.wires[i];
+            wires[i] = new Wire(nodes[record.start], nodes[record.end], (ElbowConfig)record.elbowConfig);
         }
-    };
+    });
+
+    groups.reserve(view.groups.size());
+    for (const cgb::GroupRecord& record : view.groups)
+    {
+        Color color = { record.color[0], record.color[1], record.color[2], record.color[3] };
+        groups.push_back(new Group(IRect(record.x, record.y, record.w, record.h), color, std::string(view.String(record.label))));
+    }
+    groupChunksDirty = true;
+
+    _FinishLoad();
+}
+
+void Graph::_LoadText(const std::string& filename)
+{
+    MappedFile file(filename);
+    std::string unpacked;
+    std::string_view text;
+    uint8_t filter;
+    cg::Contents contents;
+    if (!file.IsOpen() || !compression::Unpack(file.View(), unpacked, text, filter) || !cg::Parse(text, contents))
+    {
+        Log(LogType::warning, "Couldn't read {} as a graph", filename);
+        return;
+    }
+
+    _UnloadForLoad();
 
-    struct FNodeData { char gate{}; IVec2 pos{}; int extra{}; std::string name{""}; };
-    auto initNodes = [](std::vector<Node*>& nodes, const FNodeData* nodeData)
+    // Names still point into the mapped file (or its decompressed copy), so elements are built before it's closed
+    nodes.resize(contents.nodes.size());
+    ParallelFor(contents.nodes.size(), [&](size_t begin, size_t end)
     {
-        for (size_t i = 0; i < nodes.size(); ++i)
+        for (size_t i = begin; i < end; ++i)
         {
-            *nodes[i] = Node(nodeData[i].name.c_str(), nodeData[i].pos, (Gate)nodeData[i].gate, (uint8_t)nodeData[i].extra);
+            const cg::Node& parsed = contents.nodes[i];
+            Node* node = new Node(parsed.position, parsed.gate, parsed.extraParam);
+            if (!parsed.name.empty())
+                node->m_name = parsed.name;
+            nodes[i] = node;
         }
-    };
-
-    struct FWireData { int config; size_t startID, endID; };
-    auto initWires = [](const std::vector<Node*>& nodes, std::vector<Wire*>& wires, const FWireData* wireData)
+    });
+    wires.resize(contents.wires.size());
+    ParallelFor(contents.wires.size(), [&](size_t begin, size_t end)
     {
-        for (size_t i = 0; i < wires.size(); ++i)
+        for (size_t i = begin; i < end; ++i)
         {
-            *wires[i] = Wire(nodes[wireData[i].startID], nodes[wireData[i].endID], (ElbowConfig)(uint8_t)wireData[i].config);
+            const cg::Wire& parsed = contents.wires[i];
+            wires[i] = new Wire(nodes[parsed.start], nodes[parsed.end], parsed.elbowConfig);
         }
-    };
+    });
 
-    std::ifstream file(filename, std::fstream::in);
+    groups.reserve(contents.groups.size());
+    for (const GroupRecord& group : contents.groups)
     {
-        double version;
-        file >> version;
-        if (version > 1.3 || version < 1.1)
-            return;
+        groups.push_back(new Group(group.captureBounds, group.color, group.label));
+    }
+    groupChunksDirty = true;
 
-        // Unload existing
-        for (Node* node : nodes)
-        {
-            DestroyNode(node);
-        }
-        for (Wire* wire : wires)
-        {
-            DestroyWire(wire);
-        }
-        nodes.clear();
-        wires.clear();
-        // Todo: groups?
+    _FinishLoad();
+}
 
-        file.ignore(64, 'n');
-        size_t nodeCount;
-        file >> nodeCount;
+bool Graph::RecoverSession(const std::string& filename)
+{
+    Log(LogType::attempt, "Checking for unsaved session changes");
+    GraphSnapshot recovered;
+    bool isCheckpoint = recovered.LoadCheckpoint(filename);
+    // Generations have to keep climbing even when the checkpoint didn't come from a journaled session,
+    // or a stale journal could look newer than the next checkpoint
+    journalGeneration = recovered.generation;
+    size_t applied = 0;
+    for (const std::string& journalFilename : { filename + "j.prev", filename + "j" })
+    {
+        uint32_t generation = 0;
+        applied += Journal::Replay(journalFilename, isCheckpoint ? recovered.generation : UINT32_MAX, recovered, generation);
+        journalGeneration = std::max(journalGeneration, generation);
+    }
+    if (applied == 0)
+    {
+        Log(LogType::info, "Nothing to recover");
+        return false;
+    }
 
-        FNodeData* nodeData = new FNodeData[nodeCount]; // Living a little dangerous here...
+    recovered.generation = 0;
+    if (!recovered.Save(filename, owningTab->owningWindow->compressFiles))
+    {
+        // Kept on disk rather than replaced by the next rotation
+        Log(LogType::warning, "Couldn't write {}; {} journaled changes not recovered", filename, applied);
+        checkpointSaved = false;
+        return false;
+    }
+    Load(filename);
+    Log(LogType::success, "Recovered {} journaled changes", applied);
+    return true;
+}
 
-        for (size_t i = 0; i < nodeCount; ++i)
-        {
-            file >> nodeData[i].gate >> nodeData[i].pos.x >> nodeData[i].pos.y;
-            if ((Gate)nodeData[i].gate == Gate::RESISTOR || (Gate)nodeData[i].gate == Gate::LED || (Gate)nodeData[i].gate == Gate::CAPACITOR)
-                file >> nodeData[i].extra;
-            if (file.peek() != '\n')
-            {
-                file.ignore(1); // Ignore delimiting space
-                std::getline(file, nodeData[i].name);
-                Log(LogType::info, "Loaded named node " + nodeData[i].name);
-            }
-        }
+GraphSnapshot Graph::RotateJournal(const std::string& filename)
+{
+    journal.Close();
+    // The current journal is only obsolete once the new checkpoint is on disk, so it's kept as .prev until then.
+    // The old .prev can go if the checkpoint after it made it; otherwise the current journal joins it.
+    if (checkpointSaved)
+    {
+        std::error_code error;
+        std::filesystem::rename(filename + "j", filename + "j.prev", error);
+    }
+    else
+    {
+        Journal::Retire(filename + "j", filename + "j.prev");
+    }
+    checkpointSaved = false;
+
+    GraphSnapshot checkpoint = TakeSnapshot();
+    checkpoint.generation = ++journalGeneration;
+    journaledGroups = checkpoint.groups;
+    journal.Open(filename + "j", journalGeneration);
+    Log(LogType::info, "Started journal generation {}", journalGeneration);
+    return checkpoint;
+}
 
-        file.ignore(64, 'w');
-        size_t wireCount;
-        file >> wireCount;
+void Graph::CheckpointSaved()
+{
+    checkpointSaved = true;
+}
 
-        FWireData* wireData = new FWireData[wireCount];
+void Graph::FlushJournal()
+{
+    if (!journal.IsOpen())
+        return;
 
-        for (size_t i = 0; i < wireCount; ++i)
+    bool groupsChanged = groups.size() != journaledGroups.size();
+    for (size_t i = 0; !groupsChanged && i < groups.size(); ++i)
+    {
+        groupsChanged = !(journaledGroups[i] == GroupRecord{ groups[i]->captureBounds, groups[i]->color, groups[i]->label });
+    }
+    if (groupsChanged)
+    {
+        journaledGroups.clear();
+        journaledGroups.reserve(groups.size());
+        for (const Group* group : groups)
         {
-            file >> wireData[i].config >> wireData[i].startID >> wireData[i].endID;
+            journaledGroups.push_back({ group->captureBounds, group->color, group->label });
         }
+        journal.WriteGroups(journaledGroups);
+    }
 
-        if (version >= 1.2) // Version 1.2 feature
-        {
-            file.ignore(64, 'g');
-            size_t groupCount;
-            file >> groupCount;
-            groups.reserve(groupCount);
-            for (size_t i = 0; i < groupCount; ++i)
-            {
-                int x, y, w, h;
-                int r, g, b, a;
-                std::string label;
-                file
-                    >> x >> y >> w >> h
-                    >> r >> g >> b >> a;
-                file.ignore(1);
-                std::getline(file, label);
-                groups.push_back(new Group(IRect(x, y, w, h), Color((uint8_t)r, (uint8_t)g, (uint8_t)b, (uint8_t)a), label));
-            }
-        }
+    journal.Flush();
+}
 
-        std::thread allocNodesThread(allocNodes, std::ref(nodes), nodeCount);
-        std::thread allocWiresThread(allocWires, std::ref(wires), wireCount);
+const Journal& Graph::GetJournal() const
+{
+    return journal;
+}
 
-        allocNodesThread.join(); // Nodes do not rely on wire pointers to start initialization
-        if (nodes.size() != nodeCount)
-        {
-            Log(LogType::error, "Node array size mismatch");
-            exit(1);
-        }
-        std::thread initNodesThread(initNodes, std::ref(nodes), nodeData);
+void Graph::Export(const std::string& filename) const
+{
+    _Export(filename, nullptr);
+}
+void Graph::Export(const std::string& filename, IRect region) const
+{
+    _Export(filename, &region);
+}
+void Graph::ExportGroup(const std::string& filename, const Group* group) const
+{
+    _Export(filename, &group->captureBounds);
+}
 
-        allocWiresThread.join(); // Wires rely on node pointers to start initialization
-        if (wires.size() != wireCount)
+// Appends to a polyline, folding the point into the last segment when it carries straight on
+static void ExtendPolyline(std::vector<IVec2>& points, IVec2 point)
+{
+    if (!points.empty() && points.back() == point)
+        return;
+    if (points.size() >= 2)
+    {
+        IVec2 a = points[points.size() - 2];
+        IVec2 b = points.back();
+        IVec2 ab = b - a;
+        IVec2 bc = point - b;
+        bool collinear = (int64_t)ab.x * bc.y == (int64_t)ab.y * bc.x;
+        bool forwards = (int64_t)ab.x * bc.x + (int64_t)ab.y * bc.y > 0;
+        if (collinear && forwards)
         {
-            Log(LogType::error, "Wire array size mismatch");
-            exit(1);
+            points.back() = point;
+            return;
         }
-        std::thread initWiresThread(initWires, std::cref(nodes), std::ref(wires), wireData);
+    }
+    points.push_back(point);
+}
 
-        initNodesThread.join();
-        delete[] nodeData;
-        initWiresThread.join();
-        delete[] wireData;
-        
-        for (Wire* wire : wires)
+static void WriteEscapedXML(BufferedWriter& file, const std::string& text)
+{
+    size_t plain = 0;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        const char* entity;
+        switch (text[i])
         {
-            wire->start->AddWireOutput(wire);
-            wire->end->AddWireInput(wire);
-            wire->UpdateElbowToLegal();
+        case '&': entity = "&amp;"; break;
+        case '<': entity = "&lt;";  break;
+        case '>': entity = "&gt;";  break;
+        default: continue;
         }
-
-        orderDirty = true;
+        file << std::string_view(text).substr(plain, i - plain) << entity;
+        plain = i + 1;
     }
-    file.close();
-
-    Log(LogType::success, "Load complete");
+    file << std::string_view(text).substr(plain);
 }
 
-void Graph::Export(const std::string& filename) const
+void Graph::_Export(const std::string& filename, const IRect* region) const
 {
-    Log(LogType::attempt, "Exporting SVG " + filename);
+    Log(LogType::attempt, "Exporting SVG {}", filename);
+
+    // Everything, or what the indexes have in the region; wires are kept if any part of them is in it
+    std::vector<Node*> exportNodes;
+    std::vector<Wire*> exportWires;
+    if (region)
+    {
+        FindNodesInRect(exportNodes, *region);
+        _VisitChunks(wireChunks, _NodeChunkOf(region->xy), _NodeChunkOf(region->xy + region->wh - IVec2(1)), [&](const std::vector<Wire*>& chunk)
+        {
+            exportWires.insert(exportWires.end(), chunk.begin(), chunk.end());
+        });
+        std::sort(exportWires.begin(), exportWires.end());
+        exportWires.erase(std::unique(exportWires.begin(), exportWires.end()), exportWires.end());
+        std::erase_if(exportWires, [region](Wire* wire)
+        {
+            IVec2 start = wire->GetStartPos();
+            IVec2 elbow = wire->GetElbowPos();
+            IVec2 end = wire->GetEndPos();
+            return
+                std::max({ start.x, elbow.x, end.x }) < region->x || std::min({ start.x, elbow.x, end.x }) >= region->x + region->w ||
+                std::max({ start.y, elbow.y, end.y }) < region->y || std::min({ start.y, elbow.y, end.y }) >= region->y + region->h;
+        });
+    }
+    else
+    {
+        exportNodes = nodes;
+        exportWires = wires;
+    }
 
-    if (nodes.empty())
+    if (exportNodes.empty() && exportWires.empty())
     {
         Log(LogType::warning, "Nothing to export");
         return;
     }
 
-    std::ofstream file(filename, std::fstream::out | std::fstream::trunc);
+    BufferedWriter file(filename);
     {
         constexpr int r = (int)Node::g_nodeRadius;
         constexpr int w = r * 2;
@@ -1107,17 +2447,27 @@ void Graph::Export(const std::string& filename) const
         int miny = INT_MAX;
         int maxx = INT_MIN;
         int maxy = INT_MIN;
+        auto include = [&](IVec2 point)
+        {
+            minx = std::min(minx, point.x);
+            miny = std::min(miny, point.y);
+            maxx = std::max(maxx, point.x);
+            maxy = std::max(maxy, point.y);
+        };
 
         // Get extents
-        for (Node* node : nodes)
+        for (Node* node : exportNodes)
+        {
+            include(node->GetPosition());
+        }
+        for (Wire* wire : exportWires)
         {
-            if      (node->GetX() < minx) minx = node->GetX();
-            else if (node->GetX() > maxx) maxx = node->GetX();
-            if      (node->GetY() < miny) miny = node->GetY();
-            else if (node->GetY() > maxy) maxy = node->GetY();
+            include(wire->GetStartPos());
+            include(wire->GetElbowPos());
+            include(wire->GetEndPos());
         }
 
-        file << "<svg viewbox=\"" << TextFormat("%i %i %i %i", minx, miny, maxx, maxy) << "\" xmlns=\"http://www.w3.org/2000/svg\">\n";
+        file << "<svg viewBox=\"" << (minx - r) << ' ' << (miny - r) << ' ' << (maxx - minx + w) << ' ' << (maxy - miny + w) << "\" xmlns=\"http://www.w3.org/2000/svg\">\n";
 
         bool ORs  = false;
         bool ANDs = false;
@@ -1129,7 +2479,7 @@ void Graph::Export(const std::string& filename) const
         bool DELs = false;
         bool BATs = false;
 
-        for (Node* node : nodes)
+        for (Node* node : exportNodes)
         {
             switch (node->GetGate())
             {
@@ -1147,7 +2497,7 @@ void Graph::Export(const std::string& filename) const
                 break;
         }
 
-        file << "  <defs>\n"; // As long as there's at least one node on the graph we're sure to have a def.
+        file << "  <defs>\n";
         if (ORs)
         {
             file <<
@@ -1235,25 +2585,62 @@ void Graph::Export(const std::string& filename) const
         }
         file << "  </defs>\n";
 
-        if (!wires.empty())
+        if (!exportWires.empty())
         {
             file <<
                 "  <!-- Wires (drawn first so they don't obscure nodes) -->\n"
                 "  <g style=\"stroke:black; stroke-width:1; fill:none;\">\n"; // Style applied to all wires
-            for (Wire* wire : wires)
+
+            // Wires that continue from where another ends are chained into one polyline, with straight runs merged,
+            // so the output grows with the number of bends rather than the number of wires
+            std::unordered_map<IVec2, std::vector<size_t>> startingAt;
+            for (size_t i = 0; i < exportWires.size(); ++i)
+            {
+                startingAt[exportWires[i]->GetStartPos()].push_back(i);
+            }
+            std::vector<bool> written(exportWires.size(), false);
+            std::vector<IVec2> points;
+            for (size_t first = 0; first < exportWires.size(); ++first)
             {
-                int x1 = wire->GetStartX();
-                int x2 = wire->GetElbowX();
-                int x3 = wire->GetEndX();
-                int y1 = wire->GetStartY();
-                int y2 = wire->GetElbowY();
-                int y3 = wire->GetEndY();
-                file << "    <path d=\"M" << x1 << ',' << y1 << " L" << x2 << ',' << y2 << " L" << x3 << ',' << y3 << "\" />\n";
+                if (written[first])
+                    continue;
+
+                points.clear();
+                ExtendPolyline(points, exportWires[first]->GetStartPos());
+                for (size_t i = first; ; )
+                {
+                    written[i] = true;
+                    ExtendPolyline(points, exportWires[i]->GetElbowPos());
+                    ExtendPolyline(points, exportWires[i]->GetEndPos());
+
+                    auto it = startingAt.find(exportWires[i]->GetEndPos());
+                    if (it == startingAt.end())
+                        break;
+                    std::vector<size_t>& next = it->second;
+                    while (!next.empty() && written[next.back()])
+                    {
+                        next.pop_back();
+                    }
+                    if (next.empty())
+                        break;
+                    i = next.back();
+                }
+
+                if (points.size() < 2)
+                    continue; // Zero-length
+                file << "    <polyline points=\"";
+                for (size_t i = 0; i < points.size(); ++i)
+                {
+                    if (i)
+                        file << ' ';
+                    file << points[i].x << ',' << points[i].y;
+                }
+                file << "\"/>\n";
             }
             file << "  </g>\n";
         }
         file << "  <!-- Nodes (reuse shapes defined in header <def> section) -->\n";
-        for (Node* node : nodes)
+        for (Node* node : exportNodes)
         {
             const char* id;
             int x = node->GetX();
@@ -1273,13 +2660,16 @@ void Graph::Export(const std::string& filename) const
             }
             file << "  <use href=\"" << id << "\" x=\"" << x << "\" y=\"" << y << '\"';
             if (node->HasName())
-                file << "><title>" << node->GetName() << "</title></use>\n";
+            {
+                file << "><title>";
+                WriteEscapedXML(file, node->GetName());
+                file << "</title></use>\n";
+            }
             else
                 file << "/>\n";
         }
         file << "</svg>";
     }
-    file.close();
 
     Log(LogType::success, "Export complete");
 }
@@ -1,11 +1,14 @@
 #pragma once
+#include <span>
 #include "HUtility.h"
 #include "Node.h"
 #include "Wire.h"
 #include "Group.h"
 #include "Blueprint.h"
-
-enum class LogType;
+#include "History.h"
+#include "Snapshot.h"
+#include "Journal.h"
+#include "Logger.h"
 
 struct Tab;
 
@@ -20,24 +23,247 @@ private:
     std::vector<Node*> nodes;
     std::vector<Node*> startNodes;
     std::vector<Wire*> wires; // Inputs/outputs don't exist here
-    std::vector<Blueprint*> blueprints; // Todo: move this to window scope
     std::vector<Group*> groups;
 
+    std::vector<Node*> handles; // Indexed by NodeHandle; null while that node doesn't exist
+    // Dead handles that no edit in the history refers to anymore, so no undo or redo can bring their node back.
+    // Found in sweeps rather than as nodes die, once handles has grown to handleSweepAt.
+    std::vector<NodeHandle> freeHandles;
+    static constexpr size_t g_minHandleSweep = 4096;
+    size_t handleSweepAt = g_minHandleSweep;
+
+    // Collision index: every node in nodes, bucketed by which chunk of the grid its committed position falls in
+    static constexpr int g_nodeChunkSize = g_gridSize * 16;
+    std::unordered_map<IVec2, std::vector<Node*>> nodeChunks;
+    // Every wire, in each chunk its committed path (start-elbow-end between its nodes' committed positions) passes through
+    std::unordered_map<IVec2, std::vector<Wire*>> wireChunks;
+    // Every group, in each chunk its label or capture area overlaps, in the same order as groups.
+    // Groups are few and get dragged around by the whole rect, so this is rebuilt on the next lookup rather than kept in step.
+    mutable std::unordered_map<IVec2, std::vector<Group*>> groupChunks;
+    mutable std::unordered_map<const Group*, size_t> groupOrder; // Index in groups, for drawing what the chunks turn up in order
+    mutable bool groupChunksDirty = false;
+
+    // Node counts per area for drawing zoomed out, where individual nodes would be too small to read.
+    // Level 0 tiles are node chunks and each level up doubles the width, so any zoom can draw a bounded number of tiles.
+    struct DensityTile
+    {
+        uint32_t nodes = 0;
+        uint32_t active = 0;
+    };
+    static constexpr int g_densityLevels = 6;
+    static constexpr float g_densityZoom = 0.5f; // Below this, tiles are drawn instead of nodes and wires
+    static constexpr int g_densityTilePixels = 24; // Smallest on-screen tile size before moving up a level
+    std::unordered_map<IVec2, DensityTile> densityTiles[g_densityLevels];
+    std::vector<bool> densityActive; // Indexed by NodeHandle; the state each node is counted with
+
+    // Wires and nodes rasterized per area, so an idle board is a handful of texture draws.
+    // Edits redraw the areas they touch; state flips are drawn live on top instead (see Evaluate).
+    struct RenderChunk
+    {
+        RenderTexture2D wireLayer = {};
+        RenderTexture2D nodeLayer = {};
+        bool wiresDirty = true;
+        bool nodesDirty = true;
+        uint64_t lastDrawn = 0;
+        // Nodes whose output wires are left out of wireLayer and drawn live, because their state has flipped since.
+        // Active wires are drawn a pixel off from inactive ones, so they can't just be drawn over.
+        std::unordered_set<Node*> hotWires;
+        // Nodes whose state has flipped since nodeLayer was drawn; icons cover themselves, so these are drawn over it
+        std::unordered_set<Node*> flippedNodes;
+        // Capacitors show their charge, which changes without their state flipping
+        std::vector<Node*> capacitors;
+    };
+    static constexpr int g_renderChunkSize = g_nodeChunkSize * 4;
+    static constexpr size_t g_maxRenderChunks = 48; // Offscreen chunks past this are unloaded
+    mutable std::unordered_map<IVec2, RenderChunk> renderChunks;
+    // What the layers were drawn with; anything different redraws them
+    mutable float renderChunkZoom = 0.0f;
+    mutable Color renderChunkWireColors[2] = {};
+    mutable Color renderChunkNodeColors[2] = {};
+    mutable bool renderChunkLedsLit = false;
+    mutable uint64_t renderFrame = 0;
+
+    // Nodes being dragged keep their committed positions and are only drawn translated by dragOffset until EndDrag
+    std::vector<Node*> dragNodes;
+    std::vector<bool> dragMembership; // Indexed by NodeHandle
+    IVec2 dragOffset = IVec2::Zero();
+    // The group being moved or resized is recorded once, from where it started, when the tool lets go of it
+    Group* reshapedGroup = nullptr;
+    IRect reshapeFrom = IRect(0);
+    History history;
+    bool replayingHistory = false;
+
+    // Plain-data mirror of everything Save writes, kept in sync with each committed change so a snapshot is just a copy
+    CowArray<NodeRecord> nodeRecords; // Indexed by NodeHandle
+    CowArray<WireRecord> wireRecords; // Indexed by Wire::recordIndex
+    std::vector<uint32_t> freeWireRecords;
+
+    // Every record change is appended here between checkpoints
+    Journal journal;
+    uint32_t journalGeneration = 0;
+    bool checkpointSaved = true; // Whether the checkpoint from the last rotation is on disk, making the .prev journal obsolete
+    std::vector<GroupRecord> journaledGroups; // Groups are edited in place, so they're diffed at flush instead
+
+    friend class Node;
+
 private: // Internal
-    void Log(LogType type, const std::string& what) const;
+    // Checked against the log filters before anything is built
+    template<typename... Args>
+    void Log(LogType type, LogFormat format, Args&&... args) const
+    {
+        Log(type, LogCategory::graph, format, std::forward<Args>(args)...);
+    }
+    template<typename... Args>
+    void Log(LogType type, LogCategory category, LogFormat format, Args&&... args) const
+    {
+        Logger& logger = _GetLogger();
+        if (logger.IsEnabled(type, category))
+            _Log(LogEvent(logger.Now(), type, category, format, std::forward<Args>(args)...));
+    }
+    Logger& _GetLogger() const;
+    void _Log(LogEvent&& event) const;
 
     void _Free();
     // Already calls _Free!
     void _Clear();
+    static constexpr NodeHandle g_newHandle = UINT32_MAX;
+    // Pass a handle to revive a node that history refers to
+    void _AssignHandle(Node* node, NodeHandle handle = g_newHandle);
+    void _SweepHandles();
+    Node* _FromHandle(NodeHandle handle) const;
+    Edit _NodeEdit(Edit::Type type, const Node* node) const;
+    Edit _WireEdit(Edit::Type type, const Wire* wire) const;
+    void _Record(const Edit& edit, const std::string& name = "");
+    void _RecordGroup(Edit::Type type, const Group* group);
+    void _Replay(const EditBatch& batch, bool undo);
+
+    static IVec2 _NodeChunkOf(IVec2 pos);
+    // Calls visit(position, value) on each entry of a grid keyed map within the inclusive range
+    template<typename T, typename Visit>
+    static void _VisitTiles(const std::unordered_map<IVec2, T>& tiles, IVec2 minTile, IVec2 maxTile, Visit&& visit)
+    {
+        size_t tilesCovered = (size_t)(maxTile.x - minTile.x + 1) * (size_t)(maxTile.y - minTile.y + 1);
+        // Huge ranges over sparse graphs are cheaper to walk from the tiles that actually exist
+        if (tilesCovered > tiles.size())
+        {
+            for (const auto& [tile, value] : tiles)
+            {
+                if (tile.x >= minTile.x && tile.x <= maxTile.x &&
+                    tile.y >= minTile.y && tile.y <= maxTile.y)
+                    visit(tile, value);
+            }
+        }
+        else
+        {
+            for (int y = minTile.y; y <= maxTile.y; ++y)
+            {
+                for (int x = minTile.x; x <= maxTile.x; ++x)
+                {
+                    auto it = tiles.find(IVec2(x, y));
+                    if (it != tiles.end())
+                        visit(it->first, it->second);
+                }
+            }
+        }
+    }
+    // Calls visit on each bucket of chunks within the inclusive range
+    template<typename T, typename Visit>
+    static void _VisitChunks(const std::unordered_map<IVec2, std::vector<T*>>& chunks, IVec2 minChunk, IVec2 maxChunk, Visit&& visit)
+    {
+        _VisitTiles(chunks, minChunk, maxChunk, [&visit](IVec2, const std::vector<T*>& bucket) { visit(bucket); });
+    }
+    void _IndexNode(Node* node);
+    // Adjusts the node and active counts of every level of density tiles over chunk; used for adding, removing and state flips
+    void _CountDensity(IVec2 chunk, int nodeDelta, int activeDelta);
+    void _DrawDensityTiles(Color colorActive, Color colorInactive) const;
+
+    // Whether the view is drawn from render chunks rather than element by element
+    bool _UseRenderChunks() const;
+    // Calls visit on every render chunk whose layers may include something in nodeChunk
+    template<typename Visit>
+    void _VisitRenderChunksAround(IVec2 nodeChunk, Visit&& visit) const
+    {
+        // Render chunks draw everything in their node chunks plus one node chunk around them
+        constexpr int shift = 2; // log2(g_renderChunkSize / g_nodeChunkSize)
+        for (int y = (nodeChunk.y - 1) >> shift; y <= (nodeChunk.y + 1) >> shift; ++y)
+        {
+            for (int x = (nodeChunk.x - 1) >> shift; x <= (nodeChunk.x + 1) >> shift; ++x)
+            {
+                auto it = renderChunks.find(IVec2(x, y));
+                if (it != renderChunks.end())
+                    visit(it->second);
+            }
+        }
+    }
+    void _InvalidateNodeLayers(IVec2 nodeChunk);
+    void _InvalidateWireLayers(const std::vector<IVec2>& nodeChunks);
+    // Called by Evaluate for each node whose state flipped
+    void _RenderStateFlip(Node* node);
+    void _ClearRenderChunks() const;
+    void _DrawNode(const Node* node, float zoom, Color colorActive, Color colorInactive, bool ledsLit) const;
+    void _RasterizeWireLayer(IVec2 renderPos, RenderChunk& chunk, Color colorActive, Color colorInactive) const;
+    void _RasterizeNodeLayer(IVec2 renderPos, RenderChunk& chunk, float zoom, Color colorActive, Color colorInactive, bool ledsLit) const;
+    // Visible render chunks, creating any that are missing
+    void _VisibleRenderChunks(std::vector<std::pair<IVec2, RenderChunk*>>& result) const;
+    void _DrawRenderLayer(IVec2 renderPos, const RenderTexture2D& layer) const;
+    void _UnindexNode(Node* node);
+    // Called by Node::SetPosition
+    void _MoveNodeCollision(Node* node);
+    static void _WireChunksOf(std::vector<IVec2>& chunks, IVec2 start, IVec2 end, ElbowConfig elbowConfig);
+    void _IndexWire(Wire* wire);
+    // Takes the config the wire was indexed with, in case it has already been changed
+    void _UnindexWire(Wire* wire, ElbowConfig elbowConfig);
+    void _RebuildGroupChunks() const;
+    // Groups overlapping pos's chunk, in groups order
+    const std::vector<Group*>* _GroupChunkAt(IVec2 pos) const;
+    bool _IsDragged(const Node* node) const;
+    // The tab's view plus a margin for anything drawn around a position
+    IRect _VisibleBounds() const;
+    // Moves every node by offset, updating each touched wire and index entry once. Recorded as one Translate set.
+    void _TranslateNodes(const std::vector<Node*>& moving, IVec2 offset);
+
+    void _SyncNodeRecord(const Node* node);
+    void _ReleaseNodeRecord(const Node* node);
+    void _AcquireWireRecord(Wire* wire);
+    void _SyncWireRecord(const Wire* wire);
+    void _ReleaseWireRecord(const Wire* wire);
+
+    void _UnloadForLoad();
+    void _Export(const std::string& filename, const IRect* region) const;
+    void _LoadText(const std::string& filename);
+    // Reads a .cgb through a mapping of the file
+    void _LoadBinary(const std::string& filename);
+    // Links, indexes and hands out handles to freshly loaded nodes and wires
+    void _FinishLoad();
+
+    // Allocates without inserting into nodes
+    Node* _AllocNode(Node&& base, NodeHandle handle = g_newHandle);
+    // Inserts freshly allocated (unconnected) nodes at the front of nodes, in one move
+    void _InsertNodes(const std::vector<Node*>& newNodes);
     Node* _CreateNode(Node&& base);
     void _ClearNodeReferences(Node* node);
     void _DestroyNode(Node* node);
+    // Also destroys any wires still attached
+    void _DestroyNodes(const std::vector<Node*>& removeList);
 
+    // Adds, indexes, records and links the wire to its nodes, without logging; shared by the single and batch paths
+    Wire* _InsertWire(Wire&& base);
     Wire* _CreateWire(Wire&& base);
+    // Uses elbowConfig for every connection when elbowConfigs is empty
+    size_t _CreateWires(std::span<const std::pair<Node*, Node*>> connections, std::span<const ElbowConfig> elbowConfigs, ElbowConfig elbowConfig);
     void _ClearWireReferences(Wire* wire);
     void _DestroyWire(Wire* wire);
+    // Clears references and destroys in one pass over wires
+    void _DestroyWires(const std::vector<Wire*>& removeList);
 
 public:
+    // Coalesces every edit made during its lifetime into one undo step
+    struct EditGroup
+    {
+        Graph& graph;
+        EditGroup(Graph& graph) : graph(graph) { graph.BeginEditGroup(); }
+        ~EditGroup() { graph.EndEditGroup(); }
+    };
 
     Graph(Tab* owner, const std::string& name = "Unnamed graph");
     ~Graph();
@@ -58,7 +284,7 @@ public:
     // Gets the index of the node in startNodes
     size_t StartNodeID(Node* node);
     // More efficient for bulk operation
-    void DestroyNodes(std::vector<Node*>& removeList);
+    void DestroyNodes(const std::vector<Node*>& removeList);
     // Invalidates input node and all its wires!
     void BypassNode(Node* node);
     void BypassNode_Complex(Node* node);
@@ -69,40 +295,81 @@ public:
 
     // CreateWire can affect the positions of parameter `end` in `nodes`
     Wire* CreateWire(Node* start, Node* end, ElbowConfig elbowConfig = ElbowConfig(0));
+    // More efficient for bulk operation; returns the number of new wires
+    size_t CreateWires(std::span<const std::pair<Node*, Node*>> connections, ElbowConfig elbowConfig = ElbowConfig(0));
+    // Same as above, with an elbow config per connection
+    size_t CreateWires(std::span<const std::pair<Node*, Node*>> connections, std::span<const ElbowConfig> elbowConfigs);
     void DestroyWire(Wire* wire);
     // Looks like it swaps the two nodes, but really only swaps the gate!
     void SwapNodes(Node* a, Node* b);
+    void SetNodeGate(Node* node, Gate gate, uint8_t extraParam);
     // Invalidates input wire!
     Wire* ReverseWire(Wire* wire);
     // Invalidates input wire! (obviously; it's being split in two)
     std::pair<Wire*, Wire*> BisectWire(Wire* wire, Node* bisector);
+    // Use instead of Wire::SnapElbowToLegal on wires in the graph so the change gets saved
+    void SnapWireElbowToLegal(Wire* wire, IVec2 pos);
+
+    // Drag functions
+
+    // Starts drawing nodes at an offset without moving them. Any drag already going is canceled.
+    void BeginDrag(const std::vector<Node*>& nodes);
+    void SetDragOffset(IVec2 offset);
+    IVec2 GetDragOffset() const;
+    bool IsDragging() const;
+    // Where the node is drawn, which is not where it collides while it is being dragged
+    IVec2 GetDrawPosition(const Node* node) const;
+    // Moves the dragged nodes by the offset if commit is set; otherwise leaves them where they were.
+    // Either way, ends any group move (see EndGroupReshape) as part of the same undo step.
+    void EndDrag(bool commit);
 
     // Group functions
 
     Group* CreateGroup(IRect rec, Color color);
     void DestroyGroup(Group* group);
+    // Use instead of Group::SetPosition/SetCaptureBounds on groups in the graph so lookups see the change
+    void MoveGroup(Group* group, IVec2 pos);
+    void ResizeGroup(Group* group, IRect captureBounds);
+    // Records the moves and resizes since the last call as one edit, from where the group started to where it is now
+    void EndGroupReshape();
+    // Puts the group back where the reshape started, recording nothing
+    void CancelGroupReshape();
     void FindNodesInGroup(_Out_ std::vector<Node*>& result, Group* group) const;
 
+    // History functions
+
+    // Prefer EditGroup
+    void BeginEditGroup();
+    void EndEditGroup();
+    bool CanUndo() const;
+    bool CanRedo() const;
+    // Invalidates any node/wire pointers held outside the graph!
+    bool Undo();
+    // Invalidates any node/wire pointers held outside the graph!
+    bool Redo();
+
     // Blueprint functions
 
-    void StoreBlueprint(Blueprint* bp); // Todo: make this window-wide instead of tab-specific
+    // The library itself is window-wide; see BlueprintLibrary
     void SpawnBlueprint(Blueprint* bp, IVec2 topLeft);
-    const std::vector<Blueprint*>& GetBlueprints() const;
 
     // Evaluation functions
 
     // Uses BFS
     void Sort();
     void EvaluateNode(Node* node);
-    void Evaluate();
+    // Returns whether anything changed; if not, further ticks won't change anything either until the graph is edited
+    bool Evaluate();
 
     // Draw functions
-    
+    // Only what the owning tab's camera can see is drawn
+
     void DrawWires(Color colorActive, Color colorInactive) const;
     void DrawNodes(float zoom, Color colorActive, Color colorInactive) const;
     void DrawGroups() const;
 
     // Search functions
+    // Nodes are found by where they were last placed with SetPosition, not where a drag has temporarily put them
 
     Node* FindNodeAtPos(IVec2 pos) const;
     Wire* FindWireAtPos(IVec2 pos) const;
@@ -115,8 +382,29 @@ public:
 
     // Serialization functions
 
-    void Save(const std::string& filename) const;
+    // Cheap enough to take every frame; the snapshot can be saved from another thread while the graph is edited
+    GraphSnapshot TakeSnapshot() const;
+    // Returns false if the file couldn't be written
+    bool Save(const std::string& filename) const;
+    // Reads .cgb files as binary and anything else as text.
+    // Closes the session journal; its handles would be meaningless afterward
     void Load(const std::string& filename);
+
+    // Session journal functions
+
+    // Replays journals left behind by a crash onto the last checkpoint of filename, then loads the result.
+    // Returns false (without loading) if there was nothing to recover.
+    bool RecoverSession(const std::string& filename);
+    // Starts the next journal generation beside filename. The returned checkpoint covers everything before it and should be saved to filename,
+    // then reported with CheckpointSaved. Until it is, the journals it would replace are kept.
+    GraphSnapshot RotateJournal(const std::string& filename);
+    void CheckpointSaved();
+    // Writes out everything journaled this frame
+    void FlushJournal();
+    const Journal& GetJournal() const;
     // Saves the graph in SVG format
     void Export(const std::string& filename) const;
+    // Saves only what's in region: the nodes inside it and any wire passing through it
+    void Export(const std::string& filename, IRect region) const;
+    void ExportGroup(const std::string& filename, const Group* group) const;
 };
@@ -0,0 +1,145 @@
+#include "GraphBinary.h"
+#include <cstring>
+#include "Compression.h"
+#include "HUtility.h"
+#include "Node.h"
+
+namespace cgb
+{
+    bool IsBinaryFilename(const std::string& filename)
+    {
+        return filename.ends_with(".cgb");
+    }
+
+    // Whether count records of T at offset lie inside the data and are aligned for reading in place
+    template<typename T>
+    static bool SectionFits(std::string_view data, uint64_t offset, uint64_t count)
+    {
+        return
+            offset % alignof(T) == 0 &&
+            offset <= data.size() &&
+            count <= (data.size() - offset) / sizeof(T);
+    }
+
+    template<typename T>
+    static std::span<const T> Section(std::string_view data, uint64_t offset, uint64_t count)
+    {
+        return std::span<const T>(reinterpret_cast<const T*>(data.data() + offset), (size_t)count);
+    }
+
+    // The header of data if it has a current one whose node and wire sections fit
+    static const Header* RecordsHeader(std::string_view data)
+    {
+        if (data.size() < sizeof(Header))
+            return nullptr;
+        const Header* header = reinterpret_cast<const Header*>(data.data());
+        if (memcmp(header->magic, g_magic, sizeof(g_magic)) != 0 || header->version != g_version)
+            return nullptr;
+        if (!SectionFits<NodeRecord>(data, header->nodeOffset, header->nodeCount) ||
+            !SectionFits<WireRecord>(data, header->wireOffset, header->wireCount))
+            return nullptr;
+        return header;
+    }
+
+    // Unsigned so differences wrap instead of overflowing
+    static void EncodeField(uint32_t& field, uint32_t previous)
+    {
+        field -= previous;
+    }
+    static void DecodeField(uint32_t& field, uint32_t previous)
+    {
+        field += previous;
+    }
+
+    template<bool encode>
+    static bool DeltaTransform(std::string& data)
+    {
+        const Header* header = RecordsHeader(data);
+        if (!header)
+            return false;
+        auto transform = encode ? EncodeField : DecodeField;
+        NodeRecord* nodes = reinterpret_cast<NodeRecord*>(data.data() + header->nodeOffset);
+        WireRecord* wires = reinterpret_cast<WireRecord*>(data.data() + header->wireOffset);
+
+        // Encoding walks backwards so every record is still differenced against the original previous one
+        for (size_t n = 0; n + 1 < header->nodeCount; ++n)
+        {
+            size_t i = encode ? header->nodeCount - 1 - n : n + 1;
+            transform(reinterpret_cast<uint32_t&>(nodes[i].x), (uint32_t)nodes[i - 1].x);
+            transform(reinterpret_cast<uint32_t&>(nodes[i].y), (uint32_t)nodes[i - 1].y);
+            transform(nodes[i].handle, nodes[i - 1].handle);
+        }
+        for (size_t n = 0; n + 1 < header->wireCount; ++n)
+        {
+            size_t i = encode ? header->wireCount - 1 - n : n + 1;
+            transform(wires[i].start, wires[i - 1].start);
+            transform(wires[i].end, wires[i - 1].end);
+            transform(wires[i].slot, wires[i - 1].slot);
+        }
+        return true;
+    }
+
+    void DeltaEncode(std::string& data)
+    {
+        DeltaTransform<true>(data);
+    }
+
+    bool DeltaDecode(std::string& data)
+    {
+        return DeltaTransform<false>(data);
+    }
+
+    bool View::Open(const MappedFile& file, std::string& storage)
+    {
+        std::string_view data;
+        uint8_t filter;
+        if (!compression::Unpack(file.View(), storage, data, filter))
+            return false;
+        if (filter == g_deltaFilter && !DeltaDecode(storage))
+            return false;
+        return Open(data);
+    }
+
+    bool View::Open(std::string_view data)
+    {
+        const Header* header = RecordsHeader(data);
+        if (!header)
+            return false;
+        if (!SectionFits<GroupRecord>(data, header->groupOffset, header->groupCount) ||
+            !SectionFits<char>(data, header->stringOffset, header->stringSize))
+            return false;
+
+        generation = header->generation;
+        nodes = Section<NodeRecord>(data, header->nodeOffset, header->nodeCount);
+        wires = Section<WireRecord>(data, header->wireOffset, header->wireCount);
+        groups = Section<GroupRecord>(data, header->groupOffset, header->groupCount);
+        strings = std::string_view(data.data() + header->stringOffset, (size_t)header->stringSize);
+
+        auto stringFits = [this](StringRef ref) { return ref.offset <= strings.size() && ref.length <= strings.size() - ref.offset; };
+        for (const NodeRecord& node : nodes)
+        {
+            if (!stringFits(node.name))
+                return false;
+        }
+        for (const WireRecord& wire : wires)
+        {
+            if (wire.start >= nodes.size() || wire.end >= nodes.size())
+                return false;
+        }
+        // Checkpoints are loaded into arrays indexed by these
+        if (!IdsUniqueBelow(nodes, [](const NodeRecord& node) { return node.handle; }, g_maxRecordIndex) ||
+            !IdsUniqueBelow(wires, [](const WireRecord& wire) { return wire.slot; }, g_maxRecordIndex))
+            return false;
+        for (const GroupRecord& group : groups)
+        {
+            if (!stringFits(group.label))
+                return false;
+        }
+        return true;
+    }
+
+    std::string_view View::String(StringRef ref) const
+    {
+        return strings.substr(ref.offset, ref.length);
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include "MappedFile.h"
+
+// Binary session format (.cgb).
+// Laid out so a mapped file can be read in place: a header, then fixed-size node, wire and group records,
+// then a string table holding node names and group labels. Sections start on 8-byte boundaries. Little-endian.
+// Records carry the handle/slot they had when saved, so a .cgb can also serve as a journal checkpoint.
+namespace cgb
+{
+    constexpr char g_magic[4] = { 'C', 'G', 'B', '\0' };
+    constexpr uint32_t g_version = 1;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t generation; // Journal generation this is a checkpoint for; 0 if it isn't one
+        uint32_t nodeCount;
+        uint32_t wireCount;
+        uint32_t groupCount;
+        uint64_t nodeOffset;
+        uint64_t wireOffset;
+        uint64_t groupOffset;
+        uint64_t stringOffset;
+        uint64_t stringSize;
+    };
+
+    // Strings are offset/length pairs into the string table
+    struct StringRef
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct NodeRecord
+    {
+        int32_t x;
+        int32_t y;
+        uint8_t gate;
+        uint8_t extraParam;
+        uint8_t reserved[2];
+        uint32_t handle;
+        StringRef name;
+    };
+
+    struct WireRecord
+    {
+        uint32_t start; // Index into the node records
+        uint32_t end;
+        uint32_t slot;
+        uint8_t elbowConfig;
+        uint8_t reserved[3];
+    };
+
+    struct GroupRecord
+    {
+        int32_t x;
+        int32_t y;
+        int32_t w;
+        int32_t h;
+        uint8_t color[4];
+        StringRef label;
+    };
+
+    static_assert(sizeof(Header) == 64 && sizeof(NodeRecord) == 24 && sizeof(WireRecord) == 16 && sizeof(GroupRecord) == 28,
+        "Record layout is part of the file format");
+
+    bool IsBinaryFilename(const std::string& filename);
+
+    // Compression filter id for .cgb payloads whose node and wire records were delta encoded before compressing.
+    // Neighbouring records mostly differ by small steps, which leaves long runs of zero bytes for the compressor.
+    constexpr uint8_t g_deltaFilter = 1;
+    // Rewrites positions, handles and wire fields of a .cgb image in place as differences from the previous record.
+    void DeltaEncode(std::string& data);
+    // Undoes DeltaEncode. Returns false if the image is too damaged to decode.
+    bool DeltaDecode(std::string& data);
+
+    // The sections of a mapped .cgb, checked to lie within the file and to only refer to things that exist
+    class View
+    {
+    private:
+        std::string_view strings;
+
+    public:
+        uint32_t generation = 0;
+        std::span<const NodeRecord> nodes;
+        std::span<const WireRecord> wires;
+        std::span<const GroupRecord> groups;
+
+        // Returns false if data isn't a .cgb this version can read, or is damaged. data must outlive the view.
+        bool Open(std::string_view data);
+        // As above, decompressing the file into storage first if it was saved compressed
+        bool Open(const MappedFile& file, std::string& storage);
+        std::string_view String(StringRef ref) const;
+    };
+}
@@ -0,0 +1,394 @@
+#include <charconv>
+#include <cstring>
+#include "GraphText.h"
+
+namespace cg
+{
+    // Reads tokens the way the stream operators used to, but straight out of memory
+    struct Cursor
+    {
+        const char* p;
+        const char* end;
+
+        void SkipWhitespace()
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            {
+                ++p;
+            }
+        }
+        template<typename T>
+        bool Number(T& value)
+        {
+            SkipWhitespace();
+            auto [ptr, error] = std::from_chars(p, end, value);
+            if (error != std::errc())
+                return false;
+            p = ptr;
+            return true;
+        }
+        bool Char(char& c)
+        {
+            SkipWhitespace();
+            if (p == end)
+                return false;
+            c = *p++;
+            return true;
+        }
+        // Moves just past the next c within limit characters, like istream::ignore
+        void SkipPast(char c, size_t limit)
+        {
+            const char* found = (const char*)memchr(p, c, std::min((size_t)(end - p), limit));
+            p = found ? found + 1 : std::min(p + limit, end);
+        }
+        // Skips the delimiting character, then takes the rest of the line
+        std::string_view RestOfLine()
+        {
+            if (p == end || *p == '\n')
+                return {};
+            const char* begin = p + 1;
+            const char* newline = (const char*)memchr(p, '\n', end - p);
+            p = newline ? newline : end;
+            const char* lineEnd = p;
+            if (lineEnd > begin && lineEnd[-1] == '\r')
+                --lineEnd;
+            return lineEnd > begin ? std::string_view(begin, lineEnd - begin) : std::string_view();
+        }
+        void NextLine()
+        {
+            const char* newline = (const char*)memchr(p, '\n', end - p);
+            p = newline ? newline + 1 : end;
+        }
+    };
+
+    static bool HasExtraParam(Gate gate)
+    {
+        return gate == Gate::RESISTOR || gate == Gate::LED || gate == Gate::CAPACITOR;
+    }
+
+    // line spans one line without its line break
+    static bool ParseNode(Cursor line, Node& node)
+    {
+        char gate;
+        int x, y;
+        if (!line.Char(gate) || !line.Number(x) || !line.Number(y))
+            return false;
+        node.gate = (Gate)gate;
+        node.position = IVec2(x, y);
+        node.extraParam = 0;
+        if (HasExtraParam(node.gate))
+        {
+            int extraParam;
+            if (!line.Number(extraParam))
+                return false;
+            node.extraParam = (uint8_t)extraParam;
+        }
+        node.name = line.p < line.end ? std::string_view(line.p + 1, line.end - line.p - 1) : std::string_view();
+        return true;
+    }
+
+    static bool ParseWire(Cursor line, Wire& wire, size_t nodeCount)
+    {
+        int elbowConfig;
+        if (!line.Number(elbowConfig) || !line.Number(wire.start) || !line.Number(wire.end))
+            return false;
+        wire.elbowConfig = (ElbowConfig)(uint8_t)elbowConfig;
+        return wire.start < nodeCount && wire.end < nodeCount;
+    }
+
+    // Line-aligned stretch of the text, parsed by one thread
+    struct Piece
+    {
+        const char* begin;
+        const char* end;
+        size_t firstLine; // Index of the line at begin, counting from the start of the split text
+    };
+
+    bool Parse(std::string_view text, Contents& contents)
+    {
+        Cursor cursor = { text.data(), text.data() + text.size() };
+        if (!cursor.Number(contents.version) || contents.version > 1.3 || contents.version < 1.1)
+            return false;
+
+        size_t nodeCount;
+        cursor.SkipPast('n', 64);
+        if (!cursor.Number(nodeCount))
+            return false;
+        cursor.NextLine();
+
+        // Split what's left at line boundaries and count the lines in each piece, so every thread knows which lines it has
+        const char* bodyBegin = cursor.p;
+        const char* bodyEnd = cursor.end;
+        const size_t bodySize = bodyEnd - bodyBegin;
+        std::vector<Piece> pieces(ParallelPieceCount(bodySize, 1 << 20));
+        for (size_t i = 0; i < pieces.size(); ++i)
+        {
+            const char* begin = bodyBegin + bodySize * i / pieces.size();
+            if (begin > bodyBegin && begin[-1] != '\n')
+            {
+                const char* newline = (const char*)memchr(begin, '\n', bodyEnd - begin);
+                begin = newline ? newline + 1 : bodyEnd;
+            }
+            pieces[i].begin = begin;
+        }
+        for (size_t i = 0; i < pieces.size(); ++i)
+        {
+            pieces[i].end = i + 1 < pieces.size() ? pieces[i + 1].begin : bodyEnd;
+        }
+        std::vector<size_t> lineCounts(pieces.size());
+        ParallelPieces(pieces.size(), [&](size_t i)
+        {
+            lineCounts[i] = std::count(pieces[i].begin, pieces[i].end, '\n');
+        });
+        size_t lineCount = 0;
+        for (size_t i = 0; i < pieces.size(); ++i)
+        {
+            pieces[i].firstLine = lineCount;
+            lineCount += lineCounts[i];
+        }
+        if (bodySize > 0 && bodyEnd[-1] != '\n')
+            ++lineCount; // Last line has no line break
+
+        auto lineAt = [&](size_t line) -> const char*
+        {
+            if (line >= lineCount)
+                return bodyEnd;
+            auto piece = std::prev(std::upper_bound(pieces.begin(), pieces.end(), line, [](size_t line, const Piece& piece) { return line < piece.firstLine; }));
+            const char* p = piece->begin;
+            for (size_t i = piece->firstLine; i < line; ++i)
+            {
+                p = (const char*)memchr(p, '\n', bodyEnd - p) + 1;
+            }
+            return p;
+        };
+
+        size_t wireCount;
+        cursor.p = lineAt(nodeCount);
+        cursor.SkipPast('w', 64);
+        if (!cursor.Number(wireCount))
+            return false;
+        const size_t tailLine = nodeCount + 1 + wireCount;
+        if (lineCount < tailLine)
+            return false;
+
+        contents.nodes.resize(nodeCount);
+        contents.wires.resize(wireCount);
+        std::vector<char> pieceFailed(pieces.size(), false);
+        ParallelPieces(pieces.size(), [&](size_t i)
+        {
+            const Piece& piece = pieces[i];
+            const char* p = piece.begin;
+            for (size_t line = piece.firstLine; p < piece.end && line < tailLine; ++line)
+            {
+                const char* newline = (const char*)memchr(p, '\n', piece.end - p);
+                const char* lineEnd = newline ? newline : piece.end;
+                Cursor lineCursor = { p, lineEnd > p && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd };
+                bool parsed = true;
+                if (line < nodeCount)
+                    parsed = ParseNode(lineCursor, contents.nodes[line]);
+                else if (line > nodeCount)
+                    parsed = ParseWire(lineCursor, contents.wires[line - nodeCount - 1], nodeCount);
+                if (!parsed)
+                {
+                    pieceFailed[i] = true;
+                    return;
+                }
+                p = newline ? newline + 1 : piece.end;
+            }
+        });
+        if (std::find(pieceFailed.begin(), pieceFailed.end(), true) != pieceFailed.end())
+            return false;
+
+        // Groups and handles are few enough lines to read in order
+        cursor.p = lineAt(tailLine);
+        contents.groups.clear();
+        if (contents.version >= 1.2) // Version 1.2 feature
+        {
+            size_t groupCount;
+            cursor.SkipPast('g', 64);
+            if (!cursor.Number(groupCount))
+                return false;
+            contents.groups.resize(groupCount);
+            for (GroupRecord& group : contents.groups)
+            {
+                int r, g, b, a;
+                if (!(cursor.Number(group.captureBounds.x) && cursor.Number(group.captureBounds.y) &&
+                    cursor.Number(group.captureBounds.w) && cursor.Number(group.captureBounds.h) &&
+                    cursor.Number(r) && cursor.Number(g) && cursor.Number(b) && cursor.Number(a)))
+                    return false;
+                group.color = { (uint8_t)r, (uint8_t)g, (uint8_t)b, (uint8_t)a };
+                group.label = cursor.RestOfLine();
+            }
+        }
+
+        contents.generation = 0;
+        contents.handles.clear();
+        contents.slots.clear();
+        char tag = 0;
+        uint32_t generation = 0;
+        if (cursor.Char(tag) && tag == 'h' && cursor.Number(generation))
+        {
+            contents.handles.resize(nodeCount);
+            contents.slots.resize(wireCount);
+            bool complete = true;
+            for (size_t i = 0; complete && i < nodeCount; ++i)
+            {
+                complete = cursor.Number(contents.handles[i]);
+            }
+            for (size_t i = 0; complete && i < wireCount; ++i)
+            {
+                complete = cursor.Number(contents.slots[i]);
+            }
+            if (complete)
+            {
+                // Checkpoints are loaded into arrays indexed by these
+                auto id = [](uint32_t value) { return value; };
+                if (!IdsUniqueBelow(contents.handles, id, g_maxRecordIndex) || !IdsUniqueBelow(contents.slots, id, g_maxRecordIndex))
+                    return false;
+                contents.generation = generation;
+            }
+            else
+            {
+                contents.handles.clear();
+                contents.slots.clear();
+            }
+        }
+        return true;
+    }
+
+    template<typename T>
+    static void AppendNumber(std::string& out, T value)
+    {
+        char digits[24];
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+    }
+
+    void Write(const GraphSnapshot& snapshot, std::string& out)
+    {
+        // Handles can have gaps where nodes were destroyed; files want contiguous IDs
+        std::vector<size_t> nodeIDs(snapshot.nodes.Size());
+        size_t nodeCount = 0;
+        for (size_t handle = 0; handle < snapshot.nodes.Size(); ++handle)
+        {
+            if (snapshot.nodes[handle].live)
+                nodeIDs[handle] = nodeCount++;
+        }
+        size_t wireCount = 0;
+        for (size_t i = 0; i < snapshot.wires.Size(); ++i)
+        {
+            if (snapshot.wires[i].live)
+                ++wireCount;
+        }
+
+        // Node and wire lines are formatted in pieces on separate threads, then joined in order
+        auto formatPieces = [&out](size_t count, auto formatRange)
+        {
+            std::vector<std::string> pieces(ParallelPieceCount(count, 1 << 16));
+            ParallelPieces(pieces.size(), [&](size_t i)
+            {
+                formatRange(pieces[i], count * i / pieces.size(), count * (i + 1) / pieces.size());
+            });
+            for (const std::string& piece : pieces)
+            {
+                out += piece;
+            }
+        };
+
+        out.reserve(out.size() + 16 + nodeCount * 24 + wireCount * 16);
+        out += "1.3\n";
+
+        out += "n ";
+        AppendNumber(out, nodeCount);
+        out += '\n';
+        formatPieces(snapshot.nodes.Size(), [&snapshot](std::string& piece, size_t begin, size_t end)
+        {
+            piece.reserve((end - begin) * 24);
+            for (size_t handle = begin; handle < end; ++handle)
+            {
+                const NodeRecord& node = snapshot.nodes[handle];
+                if (!node.live)
+                    continue;
+
+                piece += (char)node.gate;
+                piece += ' ';
+                AppendNumber(piece, node.position.x);
+                piece += ' ';
+                AppendNumber(piece, node.position.y);
+                if (HasExtraParam(node.gate))
+                {
+                    piece += ' ';
+                    AppendNumber(piece, (int)node.extraParam);
+                }
+                if (!node.name.empty() && node.name[0] != '\0')
+                {
+                    piece += ' ';
+                    piece += node.name;
+                }
+                piece += '\n';
+            }
+        });
+
+        out += "w ";
+        AppendNumber(out, wireCount);
+        out += '\n';
+        formatPieces(snapshot.wires.Size(), [&snapshot, &nodeIDs](std::string& piece, size_t begin, size_t end)
+        {
+            piece.reserve((end - begin) * 16);
+            for (size_t i = begin; i < end; ++i)
+            {
+                const WireRecord& wire = snapshot.wires[i];
+                if (!wire.live)
+                    continue;
+
+                AppendNumber(piece, (int)wire.elbowConfig);
+                piece += ' ';
+                AppendNumber(piece, nodeIDs[wire.start]);
+                piece += ' ';
+                AppendNumber(piece, nodeIDs[wire.end]);
+                piece += '\n';
+            }
+        });
+
+        out += "g ";
+        AppendNumber(out, snapshot.groups.size());
+        out += '\n';
+        for (const GroupRecord& group : snapshot.groups)
+        {
+            for (int value : {
+                group.captureBounds.x, group.captureBounds.y, group.captureBounds.w, group.captureBounds.h,
+                (int)group.color.r, (int)group.color.g, (int)group.color.b, (int)group.color.a })
+            {
+                AppendNumber(out, value);
+                out += ' ';
+            }
+            out += group.label;
+            out += '\n';
+        }
+
+        // Handles (checkpoints only)
+        if (snapshot.generation != 0)
+        {
+            out += "h ";
+            AppendNumber(out, snapshot.generation);
+            out += '\n';
+            for (size_t handle = 0; handle < snapshot.nodes.Size(); ++handle)
+            {
+                if (snapshot.nodes[handle].live)
+                {
+                    AppendNumber(out, handle);
+                    out += ' ';
+                }
+            }
+            out += '\n';
+            for (size_t i = 0; i < snapshot.wires.Size(); ++i)
+            {
+                if (snapshot.wires[i].live)
+                {
+                    AppendNumber(out, i);
+                    out += ' ';
+                }
+            }
+            out += '\n';
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Snapshot.h"
+
+// Text graph format (.cg), version 1.3:
+//   1.3
+//   n nodeCount
+//   gate x y [extraParam] [name]          (nodeCount lines; extraParam only for resistors, capacitors and LEDs)
+//   w wireCount
+//   elbowConfig start end                  (wireCount lines; nodes by line order)
+//   g groupCount
+//   x y w h r g b a label                  (groupCount lines)
+//   h generation                           (checkpoints only; followed by a line of node handles and a line of wire slots)
+// Node and wire lines are parsed in parallel, split at line boundaries.
+namespace cg
+{
+    struct Node
+    {
+        Gate gate;
+        uint8_t extraParam;
+        IVec2 position;
+        std::string_view name; // Points into the parsed text
+    };
+
+    struct Wire
+    {
+        ElbowConfig elbowConfig;
+        uint32_t start;
+        uint32_t end;
+    };
+
+    struct Contents
+    {
+        double version = 0.0;
+        std::vector<Node> nodes;
+        std::vector<Wire> wires;
+        std::vector<GroupRecord> groups;
+        // Handle section; generation is 0 without one
+        uint32_t generation = 0;
+        std::vector<NodeHandle> handles;
+        std::vector<uint32_t> slots;
+    };
+
+    // Reads versions 1.1 through 1.3. Returns false if the text is malformed or from another version.
+    bool Parse(std::string_view text, Contents& contents);
+    // Appends the snapshot in version 1.3, with the handle section if it's a checkpoint
+    void Write(const GraphSnapshot& snapshot, std::string& out);
+}
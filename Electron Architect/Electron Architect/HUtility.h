@@ -4,6 +4,7 @@
 #include <vector>
 #include <queue>
 #include <algorithm>
+#include <thread>
 #include <limits.h>
 
 // Safe assertions for cases where you need to know, but exiting the program without some cleaning can be dangerous
@@ -74,5 +75,57 @@ void FindAndErase_ExpectExisting(Container& container, const typename Container:
     container.erase(it);
 }
 
+// Whether id(item) is below limit for every item, with no id repeated; for checking ids read from a file
+template<typename Items, typename Id>
+bool IdsUniqueBelow(const Items& items, Id&& id, uint32_t limit)
+{
+    std::vector<bool> seen;
+    for (const auto& item : items)
+    {
+        uint32_t value = id(item);
+        if (value >= limit)
+            return false;
+        if (value >= seen.size())
+            seen.resize(std::max<size_t>(value + 1, seen.size() * 2));
+        if (seen[value])
+            return false;
+        seen[value] = true;
+    }
+    return true;
+}
+
+// How many threads are worth starting for count items; below minPerPiece each, starting a thread costs more than it saves
+inline size_t ParallelPieceCount(size_t count, size_t minPerPiece = 4096)
+{
+    return std::clamp<size_t>(count / minPerPiece, 1, std::max(1u, std::thread::hardware_concurrency()));
+}
+// Calls work(piece) for every piece in [0, pieceCount), each on its own thread
+template<typename Work>
+void ParallelPieces(size_t pieceCount, Work&& work)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(pieceCount > 0 ? pieceCount - 1 : 0);
+    for (size_t piece = 1; piece < pieceCount; ++piece)
+    {
+        threads.emplace_back(work, piece);
+    }
+    if (pieceCount > 0)
+        work((size_t)0);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+// Splits [0, count) into one contiguous range per core and calls work(begin, end) on each
+template<typename Work>
+void ParallelFor(size_t count, Work&& work)
+{
+    size_t pieceCount = ParallelPieceCount(count);
+    ParallelPieces(pieceCount, [&](size_t piece)
+    {
+        work(count * piece / pieceCount, count * (piece + 1) / pieceCount);
+    });
+}
+
 bool Between_Inclusive(int x, int a, int b);
 bool Between_Exclusive(int x, int a, int b);
@@ -0,0 +1,124 @@
+#include "History.h"
+
+void History::Commit()
+{
+    if (pending.Empty())
+        return;
+
+    // A new edit branches history; whatever was undone can no longer be redone
+    redoStack.clear();
+    undoStack.push_back(std::move(pending));
+    pending = EditBatch();
+    if (undoStack.size() > g_maxUndoSteps)
+        undoStack.pop_front();
+}
+
+void History::BeginGroup()
+{
+    ++groupDepth;
+}
+void History::EndGroup()
+{
+    _ASSERT_EXPR(groupDepth > 0, L"Unbalanced edit group");
+    if (--groupDepth == 0)
+        Commit();
+}
+
+void History::Record(const Edit& edit)
+{
+    pending.edits.push_back(edit);
+    if (groupDepth == 0)
+        Commit();
+}
+void History::Record(Edit edit, const std::string& name)
+{
+    if (!name.empty())
+    {
+        edit.nameIndex = (uint32_t)pending.names.size();
+        pending.names.push_back(name);
+    }
+    Record(edit);
+}
+
+void History::Record(Edit edit, const GroupRecord& group)
+{
+    edit.groupIndex = (uint32_t)pending.groups.size();
+    pending.groups.push_back(group);
+    Record(edit);
+}
+void History::Record(Edit edit, const GroupRecord& before, const GroupRecord& after)
+{
+    edit.groupIndex = (uint32_t)pending.groups.size();
+    pending.groups.push_back(before);
+    pending.groups.push_back(after);
+    Record(edit);
+}
+
+bool History::CanUndo() const
+{
+    return !undoStack.empty();
+}
+bool History::CanRedo() const
+{
+    return !redoStack.empty();
+}
+EditBatch History::PopUndo()
+{
+    _ASSERT_EXPR(CanUndo(), L"Nothing to undo");
+    EditBatch batch = std::move(undoStack.back());
+    undoStack.pop_back();
+    return batch;
+}
+EditBatch History::PopRedo()
+{
+    _ASSERT_EXPR(CanRedo(), L"Nothing to redo");
+    EditBatch batch = std::move(redoStack.back());
+    redoStack.pop_back();
+    return batch;
+}
+void History::PushUndo(EditBatch&& batch)
+{
+    undoStack.push_back(std::move(batch));
+}
+void History::PushRedo(EditBatch&& batch)
+{
+    redoStack.push_back(std::move(batch));
+}
+
+void History::Clear()
+{
+    undoStack.clear();
+    redoStack.clear();
+    pending = EditBatch();
+}
+
+void History::MarkNodeHandles(std::vector<bool>& referenced) const
+{
+    auto mark = [&referenced](const EditBatch& batch)
+    {
+        for (const Edit& edit : batch.edits)
+        {
+            switch (edit.type)
+            {
+            case Edit::Type::CreateGroup:
+            case Edit::Type::DestroyGroup:
+            case Edit::Type::ReshapeGroup:
+                break;
+
+            default:
+                referenced[edit.node] = true;
+                referenced[edit.other] = true;
+                break;
+            }
+        }
+    };
+    for (const EditBatch& batch : undoStack)
+    {
+        mark(batch);
+    }
+    for (const EditBatch& batch : redoStack)
+    {
+        mark(batch);
+    }
+    mark(pending);
+}
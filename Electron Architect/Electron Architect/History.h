@@ -0,0 +1,95 @@
+#pragma once
+#include <deque>
+#include <string>
+#include <vector>
+#include "HUtility.h"
+#include "IVec.h"
+#include "Node.h"
+#include "Wire.h"
+#include "Snapshot.h"
+
+// A single primitive graph mutation.
+// Nodes are referred to by handle rather than pointer so that edits stay valid after the node is destroyed and recreated.
+struct Edit
+{
+    enum class Type : uint8_t
+    {
+        CreateNode,  // node, position, gate, extraParam, name
+        DestroyNode, // node, position, gate, extraParam, name
+        CreateWire,  // node (start), other (end), elbowConfig
+        DestroyWire, // node (start), other (end), elbowConfig
+        SwapGates,   // node, other
+        Retype,      // node, gate/extraParam (new), prevGate/prevExtraParam (old)
+        Translate,   // node, position (offset moved by); consecutive ones with the same offset are one set
+        CreateGroup,  // groupPosition, groupIndex
+        DestroyGroup, // groupPosition, groupIndex
+        ReshapeGroup, // groupPosition, groupIndex (old bounds), groupIndex + 1 (new bounds)
+    };
+
+    static constexpr uint32_t g_noName = UINT32_MAX;
+
+    Type type;
+    Gate gate = Gate::OR;
+    Gate prevGate = Gate::OR;
+    uint8_t extraParam = 0;
+    uint8_t prevExtraParam = 0;
+    ElbowConfig elbowConfig = ElbowConfig::horizontal;
+    NodeHandle node = 0;
+    NodeHandle other = 0;
+    IVec2 position = IVec2::Zero();
+    uint32_t nameIndex = g_noName; // Index into the owning batch's names
+    // Groups have no handles; every change to the group list is recorded, so a position in it stays meaningful through replay
+    uint32_t groupPosition = 0;
+    uint32_t groupIndex = 0; // Index into the owning batch's groups
+};
+
+// Everything done by one user action; undone and redone as a unit
+struct EditBatch
+{
+    std::vector<Edit> edits;
+    std::vector<std::string> names; // Only named nodes pay for a string
+    std::vector<GroupRecord> groups;
+
+    inline bool Empty() const
+    {
+        return edits.empty();
+    }
+};
+
+class History
+{
+private:
+    std::deque<EditBatch> undoStack;
+    std::deque<EditBatch> redoStack;
+    EditBatch pending;
+    int groupDepth = 0;
+
+    void Commit();
+
+public:
+    // Oldest batches are dropped past this
+    static constexpr size_t g_maxUndoSteps = 256;
+
+    // Edits recorded between Begin and End are coalesced into a single batch. Groups can be nested.
+    void BeginGroup();
+    void EndGroup();
+
+    void Record(const Edit& edit);
+    void Record(Edit edit, const std::string& name);
+    void Record(Edit edit, const GroupRecord& group);
+    // For ReshapeGroup
+    void Record(Edit edit, const GroupRecord& before, const GroupRecord& after);
+
+    bool CanUndo() const;
+    bool CanRedo() const;
+    EditBatch PopUndo();
+    EditBatch PopRedo();
+    // Used after a batch has been replayed to move it to the opposite stack
+    void PushUndo(EditBatch&& batch);
+    void PushRedo(EditBatch&& batch);
+
+    void Clear();
+
+    // Sets the bit of every node handle an undoable or redoable edit still refers to
+    void MarkNodeHandles(std::vector<bool>& referenced) const;
+};
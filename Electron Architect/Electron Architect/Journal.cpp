@@ -0,0 +1,239 @@
+#include <filesystem>
+#include <sstream>
+#include "Journal.h"
+
+bool Journal::IsOpen() const
+{
+    return file.is_open();
+}
+uint32_t Journal::GetGeneration() const
+{
+    return generation;
+}
+size_t Journal::GetEntryCount() const
+{
+    return entryCount;
+}
+size_t Journal::GetSize() const
+{
+    return size;
+}
+
+void Journal::Open(const std::string& filename, uint32_t generation)
+{
+    Close();
+    this->generation = generation;
+    entryCount = 0;
+    size = 0;
+    file.open(filename, std::fstream::out | std::fstream::trunc | std::fstream::binary);
+    buffer = "j " + std::to_string(generation) + '\n';
+    Flush();
+}
+void Journal::Close()
+{
+    if (!file.is_open())
+        return;
+    Flush();
+    file.close();
+}
+
+void Journal::WriteNode(NodeHandle handle, const NodeRecord& record)
+{
+    ++entryCount;
+    buffer += "N " + std::to_string(handle) + ' ' + (char)record.gate + ' ' +
+        std::to_string(record.position.x) + ' ' + std::to_string(record.position.y) + ' ' +
+        std::to_string(record.extraParam);
+    if (!record.name.empty())
+        buffer += ' ' + record.name;
+    buffer += '\n';
+}
+void Journal::WriteNodeReleased(NodeHandle handle)
+{
+    ++entryCount;
+    buffer += "n " + std::to_string(handle) + '\n';
+}
+void Journal::WriteWire(uint32_t slot, const WireRecord& record)
+{
+    ++entryCount;
+    buffer += "W " + std::to_string(slot) + ' ' + std::to_string((int)record.elbowConfig) + ' ' +
+        std::to_string(record.start) + ' ' + std::to_string(record.end) + '\n';
+}
+void Journal::WriteWireReleased(uint32_t slot)
+{
+    ++entryCount;
+    buffer += "w " + std::to_string(slot) + '\n';
+}
+void Journal::WriteGroups(const std::vector<GroupRecord>& groups)
+{
+    ++entryCount;
+    buffer += "G " + std::to_string(groups.size()) + '\n';
+    for (const GroupRecord& group : groups)
+    {
+        buffer +=
+            std::to_string(group.captureBounds.x) + ' ' + std::to_string(group.captureBounds.y) + ' ' +
+            std::to_string(group.captureBounds.w) + ' ' + std::to_string(group.captureBounds.h) + ' ' +
+            std::to_string(group.color.r) + ' ' + std::to_string(group.color.g) + ' ' +
+            std::to_string(group.color.b) + ' ' + std::to_string(group.color.a) + ' ' +
+            group.label + '\n';
+    }
+}
+
+void Journal::Flush()
+{
+    if (buffer.empty() || !file.is_open())
+        return;
+    file.write(buffer.data(), buffer.size());
+    file.flush();
+    size += buffer.size();
+    buffer.clear();
+}
+
+void Journal::Retire(const std::string& filename, const std::string& target)
+{
+    std::error_code error;
+    if (!std::filesystem::exists(target, error))
+    {
+        std::filesystem::rename(filename, target, error);
+        return;
+    }
+
+    std::ifstream from(filename, std::fstream::in | std::fstream::binary);
+    if (!from.is_open())
+        return;
+    std::string header;
+    std::getline(from, header); // Entries are absolute, so they apply just the same under target's generation
+    if (from.peek() != std::char_traits<char>::eof())
+    {
+        std::ofstream to(target, std::fstream::out | std::fstream::app | std::fstream::binary);
+        to << from.rdbuf();
+        to.close();
+        if (!to.good())
+            return;
+    }
+    from.close();
+    std::filesystem::remove(filename, error);
+}
+
+// Grows the array to fit index
+template<typename T>
+static T& EditGrowing(CowArray<T>& records, size_t index)
+{
+    if (index >= records.Size())
+        records.Grow(index + 1);
+    return records.Edit(index);
+}
+
+size_t Journal::Replay(const std::string& filename, uint32_t minGeneration, GraphSnapshot& snapshot, uint32_t& generation)
+{
+    std::ifstream file(filename, std::fstream::in | std::fstream::binary);
+    if (!file.is_open())
+        return 0;
+
+    // A line only counts once its newline made it to disk
+    std::string line;
+    auto nextLine = [&file, &line]()
+    {
+        return std::getline(file, line) && !file.eof();
+    };
+
+    {
+        uint32_t headerGeneration;
+        char tag = 0;
+        if (!nextLine() || !(std::istringstream(line) >> tag >> headerGeneration) || tag != 'j')
+            return 0;
+        generation = headerGeneration;
+        if (headerGeneration < minGeneration)
+            return 0; // Already part of the checkpoint
+    }
+
+    size_t applied = 0;
+    while (nextLine())
+    {
+        std::istringstream entry(line);
+        char tag;
+        entry >> tag;
+        switch (tag)
+        {
+        case 'N':
+        {
+            NodeHandle handle;
+            char gate;
+            int x, y, extraParam;
+            if (!(entry >> handle >> gate >> x >> y >> extraParam) || handle >= g_maxRecordIndex)
+                return applied;
+            NodeRecord& record = EditGrowing(snapshot.nodes, handle);
+            record.live = true;
+            record.gate = (Gate)gate;
+            record.position = IVec2(x, y);
+            record.extraParam = (uint8_t)extraParam;
+            record.name.clear();
+            if (entry.get() == ' ')
+                std::getline(entry, record.name);
+        }
+        break;
+
+        case 'n':
+        {
+            NodeHandle handle;
+            if (!(entry >> handle) || handle >= g_maxRecordIndex)
+                return applied;
+            EditGrowing(snapshot.nodes, handle) = NodeRecord();
+        }
+        break;
+
+        case 'W':
+        {
+            uint32_t slot;
+            int elbowConfig;
+            NodeHandle start, end;
+            if (!(entry >> slot >> elbowConfig >> start >> end) || slot >= g_maxRecordIndex)
+                return applied;
+            WireRecord& record = EditGrowing(snapshot.wires, slot);
+            record.live = true;
+            record.elbowConfig = (ElbowConfig)(uint8_t)elbowConfig;
+            record.start = start;
+            record.end = end;
+        }
+        break;
+
+        case 'w':
+        {
+            uint32_t slot;
+            if (!(entry >> slot) || slot >= g_maxRecordIndex)
+                return applied;
+            EditGrowing(snapshot.wires, slot) = WireRecord();
+        }
+        break;
+
+        case 'G':
+        {
+            size_t count;
+            if (!(entry >> count) || count >= g_maxRecordIndex)
+                return applied;
+            std::vector<GroupRecord> groups; // Not reserved; the count is only trusted as far as the lines that follow
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!nextLine())
+                    return applied; // Torn; keep the previous groups
+                std::istringstream groupEntry(line);
+                GroupRecord& group = groups.emplace_back();
+                int r, g, b, a;
+                if (!(groupEntry
+                    >> group.captureBounds.x >> group.captureBounds.y >> group.captureBounds.w >> group.captureBounds.h
+                    >> r >> g >> b >> a))
+                    return applied;
+                group.color = { (uint8_t)r, (uint8_t)g, (uint8_t)b, (uint8_t)a };
+                groupEntry.ignore(1);
+                std::getline(groupEntry, group.label);
+            }
+            snapshot.groups = std::move(groups);
+        }
+        break;
+
+        default:
+            return applied;
+        }
+        ++applied;
+    }
+    return applied;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Snapshot.h"
+
+// Append-only log of snapshot record changes, written between checkpoints so a crash only loses the last frame of edits.
+// Entries are one per line:
+//   N handle gate x y extraParam [name]   (node created or changed)
+//   n handle                              (node destroyed)
+//   W slot elbowConfig start end          (wire created or changed)
+//   w slot                                (wire destroyed)
+//   G count                               (groups replaced; followed by count lines in the .cg group format)
+class Journal
+{
+private:
+    std::ofstream file;
+    std::string buffer; // Written out by Flush
+    uint32_t generation = 0;
+    size_t entryCount = 0;
+    size_t size = 0;
+
+public:
+    bool IsOpen() const;
+    uint32_t GetGeneration() const;
+    // Entries written since Open
+    size_t GetEntryCount() const;
+    // Bytes flushed to the file since Open
+    size_t GetSize() const;
+
+    // Truncates the file and starts a journal on top of the checkpoint with the same generation
+    void Open(const std::string& filename, uint32_t generation);
+    void Close();
+
+    void WriteNode(NodeHandle handle, const NodeRecord& record);
+    void WriteNodeReleased(NodeHandle handle);
+    void WriteWire(uint32_t slot, const WireRecord& record);
+    void WriteWireReleased(uint32_t slot);
+    void WriteGroups(const std::vector<GroupRecord>& groups);
+
+    void Flush();
+
+    // Moves the journal at filename to target, or onto the end of target if there's one already; target keeps its generation.
+    // For when the checkpoint that would have made target obsolete never made it to disk.
+    static void Retire(const std::string& filename, const std::string& target);
+
+    // Applies the entries of a journal to snapshot if it was started at or after minGeneration. Stops quietly at a torn final entry.
+    // Returns the number of entries applied; generation is set from the header, or left alone if the file isn't a journal.
+    static size_t Replay(const std::string& filename, uint32_t minGeneration, GraphSnapshot& snapshot, uint32_t& generation);
+};
@@ -0,0 +1,236 @@
+#include <bit>
+#include <charconv>
+#include "HUtility.h"
+#include "BufferedWriter.h"
+#include "Logger.h"
+
+static const char* LogTypeStr(LogType type)
+{
+    switch (type)
+    {
+    case LogType::info:     return "[INFO] ";
+    case LogType::attempt:  return "[ATTEMPT] ";
+    case LogType::success:  return "[SUCCESS] ";
+    case LogType::warning:  return "[WARNING] ";
+    case LogType::error:    return "[ERROR] ";
+    default:                return "[UNKNOWN] ";
+    }
+}
+static const char* LogCategoryStr(LogCategory category)
+{
+    switch (category)
+    {
+    case LogCategory::graph:
+    case LogCategory::elements: return "[Graph] ";
+    default:                    return "";
+    }
+}
+
+constexpr const char* g_categoryNames[] = { "general", "graph", "elements", "blueprints" };
+static_assert(_countof(g_categoryNames) == std::bit_width(g_allLogCategories), "Every category needs a config name");
+
+void LogEvent::Format(std::string& out, double previousTime) const
+{
+    out += LogTypeStr(type);
+    out += LogCategoryStr(category);
+    size_t nextArg = 0;
+    for (const char* c = format; *c; ++c)
+    {
+        if (c[0] != '{' || c[1] != '}' || nextArg >= argCount)
+        {
+            out += *c;
+            continue;
+        }
+        std::visit([&](const auto& arg)
+        {
+            using Arg = std::decay_t<decltype(arg)>;
+            if constexpr (std::is_same_v<Arg, std::string>)
+                out += arg;
+            else if constexpr (std::is_same_v<Arg, double>)
+                out += std::to_string(arg);
+            else
+            {
+                char digits[24];
+                out.append(digits, std::to_chars(digits, digits + sizeof(digits), arg).ptr);
+            }
+        }, args[nextArg++]);
+        ++c;
+    }
+    out += " - t+" + std::to_string(time) + "(" + std::to_string((time - previousTime) * 1000) + "ms)";
+}
+
+Logger::Logger(const std::string& filename) :
+    cells(new Cell[g_capacity]), filename(filename), start(std::chrono::steady_clock::now())
+{
+    static_assert((g_capacity & (g_capacity - 1)) == 0, "Log capacity must be a power of two");
+    for (size_t i = 0; i < g_capacity; ++i)
+    {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    writer = std::thread(&Logger::WriterLoop, this);
+}
+Logger::~Logger()
+{
+    stopping = true;
+    published.fetch_add(1);
+    published.notify_one();
+    writer.join();
+}
+
+LogType Logger::GetMinLevel() const
+{
+    return minLevel.load(std::memory_order_relaxed);
+}
+void Logger::SetMinLevel(LogType type)
+{
+    minLevel.store(type, std::memory_order_relaxed);
+}
+uint32_t Logger::GetCategories() const
+{
+    return categories.load(std::memory_order_relaxed);
+}
+void Logger::SetCategories(uint32_t mask)
+{
+    categories.store(mask & g_allLogCategories, std::memory_order_relaxed);
+}
+
+double Logger::Now() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool Logger::TryPush(LogEvent& event)
+{
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true)
+    {
+        cell = &cells[pos & (g_capacity - 1)];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+        if (diff == 0)
+        {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+            return false; // Full; the writer hasn't reached this cell's last event yet
+        else
+            pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+    cell->event = std::move(event);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+bool Logger::TryPop(LogEvent& event)
+{
+    Cell& cell = cells[dequeuePos & (g_capacity - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1)
+        return false;
+    event = std::move(cell.event);
+    cell.sequence.store(dequeuePos + g_capacity, std::memory_order_release);
+    ++dequeuePos;
+    return true;
+}
+
+void Logger::Push(LogEvent&& event)
+{
+    while (!TryPush(event))
+    {
+        std::this_thread::yield();
+    }
+    published.fetch_add(1);
+    if (writerIdle.load())
+        published.notify_one();
+}
+
+void Logger::Flush()
+{
+    size_t target = enqueuePos.load();
+    for (size_t done = written.load(); done < target; done = written.load())
+    {
+        written.wait(done);
+    }
+}
+
+void Logger::Clear()
+{
+    LogEvent event;
+    event.time = Now();
+    Push(std::move(event));
+}
+
+void Logger::WriterLoop()
+{
+    auto file = std::make_unique<BufferedWriter>(filename);
+    double previousTime = 0.0;
+    std::string line;
+    LogEvent event;
+    while (true)
+    {
+        bool wroteAny = false;
+        while (TryPop(event))
+        {
+            wroteAny = true;
+            if (!event.format)
+            {
+                file.reset(); // Flushes before the file is reopened empty
+                file = std::make_unique<BufferedWriter>(filename);
+                previousTime = event.time;
+                continue;
+            }
+            line.clear();
+            event.Format(line, previousTime);
+            line += '\n';
+            *file << line;
+            previousTime = event.time;
+        }
+        if (wroteAny)
+        {
+            // One write per batch rather than per line, and never a sync to disk
+            file->Flush();
+            written.store(dequeuePos);
+            written.notify_all();
+            continue;
+        }
+        if (stopping)
+            return;
+
+        // Pushes check writerIdle after publishing, so one either shows up in the ring or in published before this waits
+        writerIdle = true;
+        uint32_t seen = published.load();
+        if (cells[dequeuePos & (g_capacity - 1)].sequence.load(std::memory_order_acquire) != dequeuePos + 1 && !stopping)
+            published.wait(seen);
+        writerIdle = false;
+    }
+}
+
+uint32_t Logger::ParseCategories(std::string_view list)
+{
+    uint32_t mask = 0;
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        std::string_view name = list.substr(0, comma);
+        for (size_t i = 0; i < _countof(g_categoryNames); ++i)
+        {
+            if (name == g_categoryNames[i])
+                mask |= 1u << i;
+        }
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    }
+    return mask;
+}
+std::string Logger::CategoriesToString(uint32_t mask)
+{
+    std::string list;
+    for (size_t i = 0; i < _countof(g_categoryNames); ++i)
+    {
+        if (!(mask & (1u << i)))
+            continue;
+        if (!list.empty())
+            list += ',';
+        list += g_categoryNames[i];
+    }
+    return list;
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <variant>
+
+enum class LogType
+{
+    // Just FYI
+    info = 0,
+    // Upcoming might not be successful
+    attempt = 1,
+    // Successful
+    success = 2,
+    // Unsuccessful, can still continue
+    warning = 3,
+    // Cannot continue
+    error = 4,
+};
+
+// Where an event came from; each can be muted on its own
+enum class LogCategory : uint8_t
+{
+    general,
+    graph,
+    elements, // Single nodes and wires being created and destroyed; by far the most frequent
+    blueprints,
+};
+constexpr uint32_t g_allLogCategories = 0b1111;
+
+// Message text with "{}" wherever an argument goes.
+// Only string literals are accepted, so the text can be kept by pointer until the writer thread formats it.
+struct LogFormat
+{
+    const char* text;
+    consteval LogFormat(const char* text) : text(text) {}
+};
+
+using LogArg = std::variant<int64_t, uint64_t, double, std::string>;
+
+template<typename T>
+LogArg ToLogArg(T&& value)
+{
+    using Value = std::remove_cvref_t<T>;
+    if constexpr (std::is_floating_point_v<Value>)
+        return (double)value;
+    else if constexpr (std::is_integral_v<Value> && std::is_signed_v<Value>)
+        return (int64_t)value;
+    else if constexpr (std::is_integral_v<Value>)
+        return (uint64_t)value;
+    else
+        return std::string(std::forward<T>(value));
+}
+
+// One log message, kept as its parts until something needs the text
+struct LogEvent
+{
+    static constexpr size_t g_maxArgs = 4;
+
+    double time = 0.0; // Seconds since the logger started
+    LogType type = LogType::info;
+    LogCategory category = LogCategory::general;
+    const char* format = nullptr; // Null for the logger's own control events
+    uint8_t argCount = 0;
+    std::array<LogArg, g_maxArgs> args;
+
+    LogEvent() = default;
+    template<typename... Args>
+    LogEvent(double time, LogType type, LogCategory category, LogFormat format, Args&&... args) :
+        time(time), type(type), category(category), format(format.text), argCount((uint8_t)sizeof...(Args)),
+        args{ ToLogArg(std::forward<Args>(args))... }
+    {
+        static_assert(sizeof...(Args) <= g_maxArgs, "Too many log arguments");
+    }
+
+    // The line as written to the log: type, message and time, with the time since previousTime
+    void Format(std::string& out, double previousTime) const;
+};
+
+// Logging that costs the caller almost nothing: events go into a lock-free ring and a background thread formats them
+// and writes them to the file in batches, leaving it to the OS to get them to disk.
+// Filters are checked by the caller before building an event, so muted messages never convert their arguments.
+class Logger
+{
+public:
+    static constexpr size_t g_capacity = 4096; // Events; a power of two
+
+private:
+    struct Cell
+    {
+        std::atomic_size_t sequence;
+        LogEvent event;
+    };
+
+    // Bounded multi-producer ring: each cell's sequence says whether it's free for the position claiming it or holds an event
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic_size_t enqueuePos = 0;
+    alignas(64) size_t dequeuePos = 0; // Only touched by the writer
+
+    std::atomic_uint32_t published = 0; // Bumped after every push, so an idle writer can wait on it
+    std::atomic_bool writerIdle = false;
+    std::atomic_size_t written = 0; // Events the writer has handed to the file
+    std::atomic_bool stopping = false;
+
+    std::atomic<LogType> minLevel = LogType::info;
+    std::atomic_uint32_t categories = g_allLogCategories;
+
+    std::string filename;
+    std::chrono::steady_clock::time_point start;
+    std::thread writer;
+
+    bool TryPush(LogEvent& event);
+    bool TryPop(LogEvent& event);
+    void WriterLoop();
+
+public:
+    // Truncates the file
+    explicit Logger(const std::string& filename);
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+    // Writes out everything still queued
+    ~Logger();
+
+    bool IsEnabled(LogType type, LogCategory category) const
+    {
+        return (int)type >= (int)minLevel.load(std::memory_order_relaxed) &&
+            ((categories.load(std::memory_order_relaxed) >> (int)category) & 1);
+    }
+    LogType GetMinLevel() const;
+    void SetMinLevel(LogType type);
+    // Bit per LogCategory
+    uint32_t GetCategories() const;
+    void SetCategories(uint32_t mask);
+
+    // Seconds since the logger started
+    double Now() const;
+
+    // Safe from any thread. Only waits if the ring is full, for the writer to make room.
+    void Push(LogEvent&& event);
+    // Returns once everything pushed so far is in the file
+    void Flush();
+    // Empties the file, in order with the events around it
+    void Clear();
+
+    // Category lists as written in the config, e.g. "general,graph,blueprints"
+    static uint32_t ParseCategories(std::string_view list);
+    static std::string CategoriesToString(uint32_t mask);
+};
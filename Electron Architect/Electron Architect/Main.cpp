@@ -1,13 +1,17 @@
+#include <cstdio>
 #include <thread>
 #include <raylib.h>
 #include <fstream>
 #include <filesystem>
 #include <functional>
+#include <future>
+#include <string_view>
 #include "HUtility.h"
 #include "IVec.h"
 #include "Node.h"
 #include "Wire.h"
 #include "Blueprint.h"
+#include "BlueprintLibrary.h"
 #include "Group.h"
 #include "Graph.h"
 #include "Tab.h"
@@ -15,11 +19,55 @@
 #include "UIColors.h"
 #include "Tool.h"
 #include "Window.h"
+#include "Logger.h"
+#include "Rasterizer.h"
+#include "Terminal.h"
 
 #include "program_icon.h"
 
-int main()
+// Reported both on the console it was run from, if any, and in render.log for when there isn't one
+static int RenderFailed(Logger& logger, LogEvent&& event)
 {
+    std::string line;
+    event.Format(line, event.time);
+    fprintf(stderr, "%s\n", line.c_str());
+    logger.Push(std::move(event));
+    return 1;
+}
+
+// Headless: draws a whole saved graph to a PNG without opening a window or touching the GPU
+//   --render <graph.cg|graph.cgb> <image.png> [pixels per unit: 1, 2 or 4]
+// Exits with 1 if anything goes wrong
+static int RenderGraphImage(int argc, char* argv[])
+{
+    AttachParentConsole();
+    Logger logger{ "render.log" };
+
+    if (argc < 2 || argc > 3)
+        return RenderFailed(logger, LogEvent(logger.Now(), LogType::error, LogCategory::general, "Usage: --render <graph.cg|graph.cgb> <image.png> [1|2|4]"));
+    raster::Options options;
+    if (argc == 3)
+    {
+        std::string_view scale = argv[2];
+        if (scale != "1" && scale != "2" && scale != "4")
+            return RenderFailed(logger, LogEvent(logger.Now(), LogType::error, LogCategory::general, "Pixels per unit must be 1, 2 or 4"));
+        options.pixelsPerUnit = scale[0] - '0';
+    }
+
+    raster::Scene scene;
+    if (!raster::LoadScene(argv[0], scene))
+        return RenderFailed(logger, LogEvent(logger.Now(), LogType::error, LogCategory::general, "Couldn't read {} as a graph", argv[0]));
+    if (!raster::Render(scene, argv[1], options))
+        return RenderFailed(logger, LogEvent(logger.Now(), LogType::error, LogCategory::general, "Couldn't render {} to {}", argv[0], argv[1]));
+    logger.Push(LogEvent(logger.Now(), LogType::success, LogCategory::general, "Rendered {} to {}", argv[0], argv[1]));
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string_view(argv[1]) == "--render")
+        return RenderGraphImage(argc - 2, argv + 2);
+
     /******************************************
     *   Load textures, shaders, and meshes
     ******************************************/
@@ -36,45 +84,26 @@ int main()
 
     SetWindowIcon(icon);
 
-    window.CurrentTab().graph->Load("session.cg"); // Construct and load last session
-    // Load blueprints
-    {
-        window.Log(LogType::attempt, "Loading blueprints");
-        std::filesystem::path blueprints{ "blueprints" };
-        std::filesystem::create_directories(blueprints);
-        std::filesystem::directory_iterator directory{ blueprints };
-        if (directory._At_end())
-            window.Log(LogType::info, "No blueprints found");
-        else
-        {
-            size_t count = 0;
-            for (auto const& dir_entry : directory)
-            {
-                std::string filename = dir_entry.path().string();
-                window.Log(LogType::info, "Located file \"" + filename + '\"');
-                if (filename.substr(filename.size() - 3, filename.size()) == ".bp")
-                    window.Log(LogType::attempt, "Loading blueprint \"" + filename + '\"');
-                Blueprint bp;
-                try
-                {
-                    LoadBlueprint(filename.c_str(), bp);
-                    window.CurrentTab().graph->StoreBlueprint(&bp);
-                    window.Log(LogType::success, "Blueprint loaded");
-                    ++count;
-                }
-                catch (std::length_error e)
-                {
-                    window.Log(LogType::warning, "Blueprint file corrupt");
-                }
-            }
-            window.Log(LogType::success, std::to_string(count) + " Blueprints loaded");
-        }
-    }
+    // Construct and load last session, including anything journaled since its last checkpoint
+    if (!window.CurrentTab().graph->RecoverSession("session.cgb"))
+        window.CurrentTab().graph->Load(std::filesystem::exists("session.cgb") ? "session.cgb" : "session.cg"); // Older versions saved sessions as text
+    // Loading hands out new handles, so journaling has to start from a fresh checkpoint
+    if (window.CurrentTab().graph->RotateJournal("session.cgb").Save("session.cgb", window.compressFiles))
+        window.CurrentTab().graph->CheckpointSaved();
+    else
+        window.Log(LogType::warning, "Couldn't write session.cgb");
+    // Load blueprints in the background; only their headers, from the library index, unless a file changed since it was written
+    window.Log(LogType::attempt, LogCategory::blueprints, "Loading blueprints");
+    std::filesystem::create_directories("blueprints");
+    BlueprintScanProgress blueprintProgress;
+    std::future<BlueprintLibraryScan> blueprintScan = std::async(std::launch::async, ScanBlueprintLibrary, std::string("blueprints"), &blueprintProgress);
 
     InitNodeIcons();
 
     std::atomic_bool saving = false;
+    std::atomic_bool saved = false; // Whether the last save made it to disk; read once saving is done
     double lastAutoSaveTime = 0.0;
+    constexpr size_t maxJournalSize = 4 << 20; // Compact early past this many bytes
 
     std::thread save_thread;
 
@@ -84,17 +113,50 @@ int main()
         *   Simulate frame and update variables
         ******************************************/
 
-        auto saveLambda = [&window, &saving]() { saving = true; window.CurrentTab().graph->Save("session.cg"); saving = false; };
-
-        if (save_thread.joinable())
+        if (save_thread.joinable() && !saving)
+        {
             save_thread.join();
+            if (saved)
+            {
+                window.CurrentTab().graph->CheckpointSaved();
+                window.Log(LogType::success, "Save complete");
+            }
+            else
+            {
+                window.Log(LogType::warning, "Couldn't write session.cgb");
+            }
+        }
+
+        if (blueprintScan.valid() && blueprintScan.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            BlueprintLibraryScan scan = blueprintScan.get();
+            for (const std::string& filename : scan.corrupt)
+            {
+                window.Log(LogType::warning, LogCategory::blueprints, "Blueprint file corrupt: \"{}\"", filename);
+            }
+            for (Blueprint& bp : scan.blueprints)
+            {
+                window.library.Store(std::move(bp));
+            }
+            if (scan.blueprints.empty())
+                window.Log(LogType::info, LogCategory::blueprints, "No blueprints found");
+            else
+                window.Log(LogType::success, LogCategory::blueprints, "{} Blueprints loaded ({} re-indexed)", scan.blueprints.size(), scan.reindexed);
+        }
 
         // Save file
-        if ((GetTime() - lastAutoSaveTime > 60.0) ||
-            ((IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL)) && IsKeyPressed(KEY_S) && window.GetMode() != Mode::PASTE))
+        // Edits are journaled as they happen; this just compacts the journal into a new checkpoint.
+        // The snapshot shares its data with the graph, so editing carries on while it's written out.
+        const Journal& journal = window.CurrentTab().graph->GetJournal();
+        if (!saving && (
+            (GetTime() - lastAutoSaveTime > 60.0 && journal.GetEntryCount() > 0) ||
+            journal.GetSize() > maxJournalSize ||
+            ((IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL)) && IsKeyPressed(KEY_S) && window.GetMode() != Mode::PASTE)))
         {
             lastAutoSaveTime = GetTime();
-            save_thread = std::thread(saveLambda);
+            window.Log(LogType::attempt, "Saving file session.cgb");
+            saving = true;
+            save_thread = std::thread([snapshot = window.CurrentTab().graph->RotateJournal("session.cgb"), &saving, &saved, compress = window.compressFiles]() { saved = snapshot.Save("session.cgb", compress); saving = false; });
         }
 
         if (IsWindowResized())
@@ -124,21 +186,24 @@ int main()
         }
 
         // Input
-        if (!saving) // Can't risk editing mid-save
-            window.UpdateTool();
+        window.UpdateTool();
 
     EVAL:
         window.cursorPosPrev = window.cursorPos;
         if (window.CurrentTab().graph->IsOrderDirty())
         {
-            window.tickFrame = 0;
-            window.tickThisFrame = true;
+            window.ticksThisFrame = std::max(window.ticksThisFrame, 1);
         }
-        if (window.tickThisFrame && (saving ? !window.CurrentTab().graph->IsOrderDirty() : true))
+        for (int tick = 0; tick < window.ticksThisFrame; ++tick)
         {
-            window.CurrentTab().graph->Evaluate();
+            window.simulationSettled = !window.CurrentTab().graph->Evaluate();
         }
 
+        window.CurrentTab().graph->FlushJournal();
+
+        // A save or blueprint scan in progress needs a frame to be picked up on
+        window.UpdateFramePacing(saving || save_thread.joinable() || blueprintScan.valid());
+
         /******************************************
         *   Draw the frame
         ******************************************/
@@ -195,6 +260,13 @@ int main()
                     window.PushPropertySpacer();
                 }
 
+                if (blueprintScan.valid() && blueprintProgress.total > 0)
+                {
+                    window.PushPropertySubtitle("Loading blueprints");
+                    window.PushProperty("Parsed", std::to_string(blueprintProgress.parsed) + " / " + std::to_string(blueprintProgress.total));
+                    window.PushPropertySpacer();
+                }
+
                 if (!inMenu)
                 {
                     window.PushPropertySubtitle("Mode");
@@ -240,11 +312,6 @@ int main()
                         window.FontSize(),
                         UIColor(UIColorID::UI_COLOR_FOREGROUND),
                         UIColor(UIColorID::UI_COLOR_BACKGROUND));
-
-                if (saving)
-                {
-                    DrawText("Saving...", Button::g_width * 4, Button::g_width, window.FontSize(), UIColor(UIColorID::UI_COLOR_FOREGROUND));
-                }
             }
 
         } EndDrawing();
@@ -254,6 +321,9 @@ int main()
     *   Unload and free memory
     ******************************************/
 
+    if (save_thread.joinable())
+        save_thread.join();
+
     window.SaveConfig();
 
     FreeNodeIcons();
@@ -266,7 +336,6 @@ int main()
 * -Improve groups
 * -Fix wonky zooming
 * -More explanation of controls
-* -Undo/redo
 * -Blueprint pallet
 * -Prefab blueprints for things like timers, counters, and latches
 * -Blueprint pallet icons (User-made combination of 4 premade icons. See Factorio for inspiration)
@@ -275,7 +344,6 @@ int main()
 * -Menu screen (Open to file menu with "new" at the top)
 *
 * Refactors
-* -Refactor Graph to have a bulk destroy function to make bulk deletion more efficient
 * -Refactor buttons to be classes/structs instead of freeform
 * 
 * Beyond v1.0.0
@@ -0,0 +1,109 @@
+#include <cstdint>
+#include "MappedFile.h"
+// Kept apart from everything else; the Windows headers clash with raylib
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filename)
+{
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return;
+    file = fileHandle;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize))
+    {
+        Close();
+        return;
+    }
+    size = (size_t)fileSize.QuadPart;
+    if (size == 0)
+        return; // Empty files can't be mapped, but they're still open
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mappingHandle)
+    {
+        Close();
+        return;
+    }
+    mapping = mappingHandle;
+    data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        Close();
+        return;
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    file = (void*)(intptr_t)(fd + 1); // Offset so that fd 0 isn't mistaken for null
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        Close();
+        return;
+    }
+    size = (size_t)info.st_size;
+    if (size == 0)
+        return;
+    void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED)
+    {
+        Close();
+        return;
+    }
+    data = (const char*)view;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (data)
+        UnmapViewOfFile(data);
+    if (mapping)
+        CloseHandle((HANDLE)mapping);
+    if (file)
+        CloseHandle((HANDLE)file);
+#else
+    if (data)
+        munmap((void*)data, size);
+    if (file)
+        close((int)(intptr_t)file - 1);
+#endif
+    data = nullptr;
+    size = 0;
+    file = nullptr;
+    mapping = nullptr;
+}
+
+bool MappedFile::IsOpen() const
+{
+    return !!file;
+}
+const char* MappedFile::Data() const
+{
+    return data;
+}
+size_t MappedFile::Size() const
+{
+    return size;
+}
+std::string_view MappedFile::View() const
+{
+    return std::string_view(data, size);
+}
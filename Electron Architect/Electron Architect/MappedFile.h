@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole file, mapped into memory rather than read into a buffer.
+// Pages are only read in as they're touched, and several threads can read the view at once.
+class MappedFile
+{
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    // Platform handles, kept opaque so this header doesn't drag in the OS headers
+    void* file = nullptr;
+    void* mapping = nullptr;
+
+    void Close();
+
+public:
+    MappedFile() = default;
+    // Check IsOpen afterward; a missing or unreadable file leaves the view empty
+    explicit MappedFile(const std::string& filename);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool IsOpen() const;
+    const char* Data() const;
+    size_t Size() const;
+    std::string_view View() const;
+};
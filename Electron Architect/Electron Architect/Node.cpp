@@ -1,6 +1,9 @@
+#include <cstring>
+#include <rlgl.h>
 #include "HUtility.h"
 #include "Wire.h"
 #include "Node.h"
+#include "Graph.h"
 
 #include "nodeicons/code/nodeIconsBasic8x.h"
 #include "nodeicons/code/nodeIconsNTD8x.h"
@@ -15,24 +18,23 @@
 #include "nodeicons/code/nodeIconsBackground32x.h"
 #include "nodeicons/code/nodeIconsHighlight32x.h"
 
-enum class NodeIconType
-{
-    Basic,
-    NTD,
-    Background,
-    Highlight,
-};
 enum class NodeIconScale
 {
     x8,
     x16,
     x32,
 };
-Texture2D g_nodeIcons[4][3];
-Texture2D& NodeIcon(NodeIconType type, NodeIconScale scale)
-{
-    return g_nodeIcons[(int)type][(int)scale];
-}
+
+// Every icon sheet packed into one texture, so drawing nodes never switches textures and raylib can batch the whole pass.
+// Each type gets a column as wide as the largest sheet, with its scales stacked top to bottom.
+// The unused space right of the 8x sheet holds a white block that shapes are pointed at while batching.
+constexpr int g_atlasColumnWidth = 128;
+constexpr int g_atlasScaleY[3] = { 0, 32, 96 };
+constexpr int g_atlasWidth = g_atlasColumnWidth * 4;
+constexpr int g_atlasHeight = 224;
+constexpr IVec2 g_atlasWhitePos = IVec2(64, 0);
+constexpr int g_atlasWhiteSize = 4;
+Texture2D g_nodeIconAtlas;
 
 void DrawNodeIcon(IVec2 pos, NodeIconType type, float zoom, Gate gate, Color tint)
 {
@@ -58,55 +60,103 @@ void DrawNodeIcon(IVec2 pos, NodeIconType type, float zoom, Gate gate, Color tin
     case 4: scale = NodeIconScale::x32; break;
     }
 
-    const Texture2D& tex = NodeIcon(type, scale);
-    IVec2 textureSheetPos;
-    switch (gate)
-    {
-    default: _ASSERT_EXPR(false, L"Gate type not given specialize draw method");
-    case Gate::OR:          textureSheetPos = IVec2(0, 0); break;
-    case Gate::NOR:         textureSheetPos = IVec2(1, 0); break;
-    case Gate::AND:         textureSheetPos = IVec2(2, 0); break;
-    case Gate::XOR:         textureSheetPos = IVec2(3, 0); break;
-    case Gate::RESISTOR:    textureSheetPos = IVec2(0, 1); break;
-    case Gate::CAPACITOR:   textureSheetPos = IVec2(1, 1); break;
-    case Gate::LED:         textureSheetPos = IVec2(2, 1); break;
-    case Gate::DELAY:       textureSheetPos = IVec2(3, 1); break;
-    case Gate::BATTERY:     textureSheetPos = IVec2(0, 2); break;
-    }
+    IVec2 textureSheetPos = NodeIconSheetPos(gate);
 
     Rectangle src;
-    src.x = (float)width * (float)textureSheetPos.x;
-    src.y = (float)width * (float)textureSheetPos.y;
+    src.x = (float)(g_atlasColumnWidth * (int)type + width * textureSheetPos.x);
+    src.y = (float)(g_atlasScaleY[(int)scale] + width * textureSheetPos.y);
     src.width = src.height  = (float)width;
 
-    DrawTexturePro(tex, src, dest, { 0 }, 0.0f, tint);
+    DrawTexturePro(g_nodeIconAtlas, src, dest, { 0 }, 0.0f, tint);
 }
 
-void InitNodeIcons()
+Image NodeIconSheet(NodeIconType type, int pixelsPerUnit)
+{
+    static const Image sheets[4][3] =
+    {
+        { MEMORY_IMAGE(NODEICONSBASIC8X),      MEMORY_IMAGE(NODEICONSBASIC16X),      MEMORY_IMAGE(NODEICONSBASIC32X)      },
+        { MEMORY_IMAGE(NODEICONSNTD8X),        MEMORY_IMAGE(NODEICONSNTD16X),        MEMORY_IMAGE(NODEICONSNTD32X)        },
+        { MEMORY_IMAGE(NODEICONSBACKGROUND8X), MEMORY_IMAGE(NODEICONSBACKGROUND16X), MEMORY_IMAGE(NODEICONSBACKGROUND32X) },
+        { MEMORY_IMAGE(NODEICONSHIGHLIGHT8X),  MEMORY_IMAGE(NODEICONSHIGHLIGHT16X),  MEMORY_IMAGE(NODEICONSHIGHLIGHT32X)  },
+    };
+    NodeIconScale scale;
+    switch (pixelsPerUnit)
+    {
+    default: _ASSERT_EXPR(false, L"Node icons only come in 8x, 16x and 32x");
+    case 1: scale = NodeIconScale::x8;  break;
+    case 2: scale = NodeIconScale::x16; break;
+    case 4: scale = NodeIconScale::x32; break;
+    }
+    return sheets[(int)type][(int)scale];
+}
+IVec2 NodeIconSheetPos(Gate gate)
 {
-    NodeIcon(NodeIconType::Basic,       NodeIconScale::x8 ) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSBASIC8X ));
-    NodeIcon(NodeIconType::Basic,       NodeIconScale::x16) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSBASIC16X));
-    NodeIcon(NodeIconType::Basic,       NodeIconScale::x32) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSBASIC32X));
-    NodeIcon(NodeIconType::NTD,         NodeIconScale::x8 ) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSNTD8X ));
-    NodeIcon(NodeIconType::NTD,         NodeIconScale::x16) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSNTD16X));
-    NodeIcon(NodeIconType::NTD,         NodeIconScale::x32) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSNTD32X));
-    NodeIcon(NodeIconType::Background,  NodeIconScale::x8 ) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSBACKGROUND8X ));
-    NodeIcon(NodeIconType::Background,  NodeIconScale::x16) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSBACKGROUND16X));
-    NodeIcon(NodeIconType::Background,  NodeIconScale::x32) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSBACKGROUND32X));
-    NodeIcon(NodeIconType::Highlight,   NodeIconScale::x8 ) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSHIGHLIGHT8X ));
-    NodeIcon(NodeIconType::Highlight,   NodeIconScale::x16) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSHIGHLIGHT16X));
-    NodeIcon(NodeIconType::Highlight,   NodeIconScale::x32) = LoadTextureFromImage(MEMORY_IMAGE(NODEICONSHIGHLIGHT32X));
+    switch (gate)
+    {
+    default: _ASSERT_EXPR(false, L"Gate type not given specialize draw method");
+    case Gate::OR:          return IVec2(0, 0);
+    case Gate::NOR:         return IVec2(1, 0);
+    case Gate::AND:         return IVec2(2, 0);
+    case Gate::XOR:         return IVec2(3, 0);
+    case Gate::RESISTOR:    return IVec2(0, 1);
+    case Gate::CAPACITOR:   return IVec2(1, 1);
+    case Gate::LED:         return IVec2(2, 1);
+    case Gate::DELAY:       return IVec2(3, 1);
+    case Gate::BATTERY:     return IVec2(0, 2);
+    }
 }
 
-void FreeNodeIcons()
+void InitNodeIcons()
 {
-    for (auto& row : g_nodeIcons)
+    Image atlas = GenImageColor(g_atlasWidth, g_atlasHeight, BLANK);
+    uint8_t* atlasPixels = (uint8_t*)atlas.data;
+    constexpr int bytesPerPixel = 4;
+
+    // Copied row by row rather than with ImageDraw, which would blend
+    for (int type = 0; type < 4; ++type)
     {
-        for (const Texture2D& tex : row)
+        for (int scale = 0; scale < 3; ++scale)
         {
-            UnloadTexture(tex);
+            Image sheet = NodeIconSheet((NodeIconType)type, 1 << scale);
+            _ASSERT_EXPR(sheet.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8, L"Node icon sheets must be RGBA8");
+            _ASSERT_EXPR(sheet.width <= g_atlasColumnWidth && g_atlasScaleY[scale] + sheet.height <= g_atlasHeight, L"Node icon sheet does not fit its atlas slot");
+            const uint8_t* sheetPixels = (const uint8_t*)sheet.data;
+            for (int row = 0; row < sheet.height; ++row)
+            {
+                size_t dest = ((size_t)(g_atlasScaleY[scale] + row) * g_atlasWidth + (size_t)(g_atlasColumnWidth * type)) * bytesPerPixel;
+                memcpy(atlasPixels + dest, sheetPixels + (size_t)row * sheet.width * bytesPerPixel, (size_t)sheet.width * bytesPerPixel);
+            }
         }
     }
+    for (int row = 0; row < g_atlasWhiteSize; ++row)
+    {
+        size_t dest = ((size_t)(g_atlasWhitePos.y + row) * g_atlasWidth + g_atlasWhitePos.x) * bytesPerPixel;
+        memset(atlasPixels + dest, 0xFF, (size_t)g_atlasWhiteSize * bytesPerPixel);
+    }
+
+    g_nodeIconAtlas = LoadTextureFromImage(atlas);
+    UnloadImage(atlas);
+}
+
+void FreeNodeIcons()
+{
+    UnloadTexture(g_nodeIconAtlas);
+}
+
+void BeginNodeIconBatch()
+{
+    // Sample from the middle of the white block so no filtering can reach the icons around it
+    SetShapesTexture(g_nodeIconAtlas, Rectangle{ (float)g_atlasWhitePos.x + 1, (float)g_atlasWhitePos.y + 1, 2, 2 });
+}
+void EndNodeIconBatch()
+{
+    // raylib's own default
+    SetShapesTexture(Texture2D{ rlGetTextureIdDefault(), 1, 1, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 }, Rectangle{ 0, 0, 1, 1 });
+}
+
+NodeHandle Node::GetHandle() const
+{
+    return m_handle;
 }
 
 IVec2 Node::GetPosition() const
@@ -123,10 +173,12 @@ void Node::SetPosition_Temporary(IVec2 position)
     }
 }
 // Sets the position of the node and updates its collision in Graph
-// NOTE: Graph collision is currently a saved-for-later feature
 void Node::SetPosition(IVec2 position)
 {
     SetPosition_Temporary(position);
+    if (!!m_owningGraph)
+        m_owningGraph->_MoveNodeCollision(this);
+    SyncRecord();
 }
 int Node::GetX() const
 {
@@ -158,6 +210,7 @@ const std::string& Node::GetName() const
 void Node::SetName(const std::string& name)
 {
     m_name = name;
+    SyncRecord();
 }
 
 Gate Node::GetGate() const
@@ -167,8 +220,14 @@ Gate Node::GetGate() const
 void Node::SetGate(Gate gate)
 {
     m_gate = gate;
+    SyncRecord();
 }
 
+uint8_t Node::GetExtraParam() const
+{
+    // The first byte of every non-transistor data member is its parameter
+    return m_ntd.r.resistance;
+}
 // Only use if this is a resistor
 uint8_t Node::GetResistance() const
 {
@@ -221,18 +280,21 @@ void Node::SetResistance(uint8_t resistance)
     _ASSERT_EXPR(m_gate == Gate::RESISTOR, L"Cannot access the resistance of a non-resistor.");
     _ASSERT_EXPR(resistance <= 9, L"Selected resistance out of bounds");
     m_ntd.r.resistance = resistance;
+    SyncRecord();
 }
 void Node::SetColorIndex(uint8_t colorIndex)
 {
     _ASSERT_EXPR(m_gate == Gate::LED, L"Cannot access the color of a non-LED.");
     _ASSERT_EXPR(colorIndex <= 9, L"Selected color out of bounds");
     m_ntd.l.colorIndex = colorIndex;
+    SyncRecord();
 }
 // Only use if this is a capacitor
 void Node::SetCapacity(uint8_t capacity)
 {
     _ASSERT_EXPR(m_gate == Gate::CAPACITOR, L"Cannot access the capacity of a non-capacitor.");
     m_ntd.c.capacity = capacity;
+    SyncRecord();
 }
 // Only use if this is a capacitor
 void Node::SetCharge(uint8_t charge)
@@ -258,9 +320,15 @@ bool Node::GetState() const
     return m_state;
 }
 
-std::deque<Wire*>::const_iterator Node::FindConnection(Node* other) const
+Wire* Node::FindConnection(Node* other) const
 {
-    return std::find_if(m_wires.begin(), m_wires.end(), [&other](Wire* wire) { return wire->start == other || wire->end == other; });
+    if (m_connectionIndex)
+    {
+        auto it = m_connectionIndex->find(other);
+        return it != m_connectionIndex->end() ? it->second : nullptr;
+    }
+    auto it = std::find_if(m_wires.begin(), m_wires.end(), [&other](Wire* wire) { return wire->start == other || wire->end == other; });
+    return it != m_wires.end() ? *it : nullptr;
 }
 
 size_t Node::GetInputCount() const
@@ -360,14 +428,68 @@ void Node::SetState(bool state)
     m_state = state;
 }
 
+void Node::SyncRecord()
+{
+    if (!!m_owningGraph)
+        m_owningGraph->_SyncNodeRecord(this);
+}
+
+Node* Node::GetOtherEnd(Wire* wire) const
+{
+    return wire->start == this ? wire->end : wire->start;
+}
+void Node::IndexConnection(Wire* wire)
+{
+    if (m_connectionIndex)
+    {
+        m_connectionIndex->emplace(GetOtherEnd(wire), wire);
+        return;
+    }
+    if (m_wires.size() <= g_connectionIndexThreshold)
+        return;
+
+    m_connectionIndex = std::make_unique<std::unordered_map<Node*, Wire*>>();
+    m_connectionIndex->reserve(m_wires.size() * 2);
+    for (Wire* existing : m_wires)
+    {
+        m_connectionIndex->emplace(GetOtherEnd(existing), existing);
+    }
+}
+void Node::UnindexConnection(Wire* wire)
+{
+    if (!m_connectionIndex)
+        return;
+
+    // Half the threshold so that a node hovering around it doesn't rebuild every edit
+    if (m_wires.size() < g_connectionIndexThreshold / 2)
+    {
+        m_connectionIndex.reset();
+        return;
+    }
+
+    Node* other = GetOtherEnd(wire);
+    auto it = m_connectionIndex->find(other);
+    if (it == m_connectionIndex->end() || it->second != wire)
+        return;
+
+    // Fall back on any remaining wire to the same node
+    auto remaining = std::find_if(m_wires.begin(), m_wires.end(), [&other](Wire* wire) { return wire->start == other || wire->end == other; });
+    if (remaining != m_wires.end())
+        it->second = *remaining;
+    else
+        m_connectionIndex->erase(it);
+}
+
 void Node::AddWireInput(Wire* input)
 {
     m_wires.push_front(input);
     m_inputs++;
+    IndexConnection(input);
 }
 void Node::AddWireOutput(Wire* output)
 {
     m_wires.push_back(output);
+    IndexConnection(output);
 }
 
 // Expects the wire to exist; throws a debug exception if it is not found.
@@ -376,6 +498,7 @@ void Node::RemoveWire_Expected(Wire* wire)
     m_wires.erase(FindWireIter_Expected(wire));
     if (WireIsInput(wire))
         m_inputs--;
+    UnindexConnection(wire);
 }
 void Node::RemoveWire(Wire* wire)
 {
@@ -386,20 +509,20 @@ void Node::RemoveWire(Wire* wire)
     m_wires.erase(it);
     if (WireIsInput(wire))
         m_inputs--;
+    UnindexConnection(wire);
 }
 
 // Expects the wire to exist; throws a debug exception if it is not found.
 void Node::RemoveConnection_Expected(Node* node)
 {
-    auto it = FindConnection(node);
-    _ASSERT_EXPR(it != m_wires.end(), L"Expected connection to be pre-existing");
-    m_wires.erase(it);
+    Wire* wire = FindConnection(node);
+    _ASSERT_EXPR(!!wire, L"Expected connection to be pre-existing");
+    RemoveWire_Expected(wire);
 }
 void Node::RemoveConnection(Node* node)
 {
-    auto it = FindConnection(node);
-    if (it != m_wires.end())
-        m_wires.erase(it);
+    if (Wire* wire = FindConnection(node))
+        RemoveWire(wire);
 }
 
 // Converts an existing wire
@@ -423,9 +546,9 @@ void Node::MakeWireOutput(Wire* wire)
 
 
 Node::Node(IVec2 position, Gate gate) :
-    m_name(""), m_position(position), m_gate(gate), m_state(false), m_inputs(0), m_ntd() {}
+    m_owningGraph(), m_handle(), m_collisionPosition(position), m_name(""), m_position(position), m_gate(gate), m_state(false), m_inputs(0), m_ntd() {}
 Node::Node(IVec2 position, Gate gate, uint8_t extraParam) :
-    m_name(""), m_position(position), m_gate(gate), m_state(false), m_inputs(0)
+    m_owningGraph(), m_handle(), m_collisionPosition(position), m_name(""), m_position(position), m_gate(gate), m_state(false), m_inputs(0)
 {
     if (gate == Gate::RESISTOR)
         m_ntd.r.resistance = extraParam;
@@ -438,7 +561,7 @@ Node::Node(IVec2 position, Gate gate, uint8_t extraParam) :
     }
 }
 Node::Node(const char* name, IVec2 position, Gate gate, uint8_t extraParam) :
-    m_name(name), m_position(position), m_gate(gate), m_state(false), m_inputs(0)
+    m_owningGraph(), m_handle(), m_collisionPosition(position), m_name(name), m_position(position), m_gate(gate), m_state(false), m_inputs(0)
 {
     if (gate == Gate::RESISTOR)
         m_ntd.r.resistance = extraParam;
@@ -475,7 +598,3 @@ Range<std::deque<Wire*>::const_iterator> Node::GetOutputsConst() const
     return MakeRange<std::deque<Wire*>>(m_wires, m_inputs, m_wires.size());
 }
 
-bool Node::IsValidConnection(std::deque<Wire*>::const_iterator it) const
-{
-    return it != m_wires.end();
-}
@@ -1,7 +1,16 @@
 #pragma once
+#include <memory>
+#include <unordered_map>
 #include "IVec.h"
 
 struct Wire;
+class Graph;
+
+// Stable identifier for a node within its graph; survives the node being destroyed and recreated by undo/redo
+using NodeHandle = uint32_t;
+// Loaders treat handles and wire record slots past this as damage rather than allocating records up to them;
+// a session would have to create this many nodes between loads to get there
+constexpr uint32_t g_maxRecordIndex = 1u << 24;
 
 enum class Gate : char
 {
@@ -18,17 +27,35 @@ enum class Gate : char
     BATTERY = '#',
 };
 
+enum class NodeIconType
+{
+    Basic,
+    NTD,
+    Background,
+    Highlight,
+};
+
+// The icon art itself, for drawing without a GPU context: RGBA8 sheets of white icons, tinted by multiplying.
+// pixelsPerUnit is 1, 2 or 4, for the 8x, 16x and 32x sheets; each icon is 8 * pixelsPerUnit pixels square.
+Image NodeIconSheet(NodeIconType type, int pixelsPerUnit);
+// Which icon of a sheet a gate uses, counted in icons from the top-left
+IVec2 NodeIconSheetPos(Gate gate);
+
 void InitNodeIcons();
 void FreeNodeIcons();
+// Between these, raylib's rectangles come out of the node icon atlas too, so they batch with the icons instead of switching textures
+void BeginNodeIconBatch();
+void EndNodeIconBatch();
 
 class Node
 {
 public:
+    NodeHandle GetHandle() const;
+
     IVec2 GetPosition() const;
     // Moves the node without updating its collision
     void SetPosition_Temporary(IVec2 position);
     // Sets the position of the node and updates its collision in Graph
-    // NOTE: Graph collision is currently a saved-for-later feature
     void SetPosition(IVec2 position);
     int GetX() const;
     void SetX(int x);
@@ -42,6 +69,8 @@ public:
     Gate GetGate() const;
     void SetGate(Gate gate);
 
+    // Resistance, color index, or capacity, whichever this gate uses
+    uint8_t GetExtraParam() const;
     uint8_t GetResistance() const;
     uint8_t GetColorIndex() const;
     static const char* GetColorName(uint8_t index);
@@ -57,7 +86,8 @@ public:
 
     bool GetState() const;
 
-    std::deque<Wire*>::const_iterator FindConnection(Node* other) const;
+    // Returns the wire between this node and other, or null if they aren't connected
+    Wire* FindConnection(Node* other) const;
 
     size_t GetInputCount() const;
     size_t GetOutputCount() const;
@@ -95,6 +125,14 @@ private: // Helpers usable only by Graph
 
     void SetState(bool state);
 
+    // Pushes saved state (position, gate, parameter, name) to the owning graph's snapshot records
+    void SyncRecord();
+
+    Node* GetOtherEnd(Wire* wire) const;
+    // Keeps m_connectionIndex in sync; call after m_wires has been modified
+    void IndexConnection(Wire* wire);
+    void UnindexConnection(Wire* wire);
+
     void AddWireInput(Wire* input);
     void AddWireOutput(Wire* output);
 
@@ -112,7 +150,7 @@ private: // Helpers usable only by Graph
     void MakeWireOutput(Wire* wire);
 
 private: // Accessible by Graph
-    Node() : m_name(""), m_position(), m_gate(), m_state(), m_inputs(), m_ntd() {}
+    Node() : m_owningGraph(), m_handle(), m_collisionPosition(), m_name(""), m_position(), m_gate(), m_state(), m_inputs(), m_ntd() {}
     Node(IVec2 position, Gate gate);
     // It is entirely safe to pass in an extra param even if the node cannot use it!
     Node(IVec2 position, Gate gate, uint8_t extraParam);
@@ -135,6 +173,9 @@ public:
     static constexpr float g_nodeRadius = 3.0f;
 
 private:
+    Graph* m_owningGraph; // Null until the node is given a handle by a graph
+    NodeHandle m_handle;
+    IVec2 m_collisionPosition; // Where the graph's collision index has this node; lags m_position during temporary moves
     std::string m_name; // Tooltip
     IVec2 m_position;
     Gate m_gate;
@@ -168,6 +209,11 @@ private:
     } m_ntd;
     // Keep this partitioned by inputs vs outputs
     std::deque<Wire*> m_wires;
+    // Neighbor -> wire lookup, only allocated once the node has more than g_connectionIndexThreshold wires
+    std::unique_ptr<std::unordered_map<Node*, Wire*>> m_connectionIndex;
+
+public:
+    static constexpr size_t g_connectionIndexThreshold = 32;
 
 private:
     Range<std::deque<Wire*>::iterator> GetInputs();
@@ -177,6 +223,4 @@ public:
     const std::deque<Wire*>& GetWires() const;
     Range<std::deque<Wire*>::const_iterator> GetInputsConst() const;
     Range<std::deque<Wire*>::const_iterator> GetOutputsConst() const;
-
-    bool IsValidConnection(std::deque<Wire*>::const_iterator it) const;
 };
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include "HUtility.h"
+#include "PngWriter.h"
+
+// Deflate with the fixed Huffman codes (RFC 1951 3.2.6) and a single-candidate hash match finder.
+// Rendered boards are mostly flat colour, which filters to runs of zeros, so that does nearly as well as dynamic codes.
+constexpr size_t g_minMatch = 4; // Deflate allows 3, but the match finder hashes 4 bytes
+constexpr size_t g_maxMatch = 258;
+constexpr size_t g_windowSize = 32768;
+constexpr uint32_t g_adlerBase = 65521;
+
+constexpr uint16_t g_lengthBase[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+constexpr uint8_t g_lengthExtra[]  = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+constexpr uint16_t g_distanceBase[] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+constexpr uint8_t g_distanceExtra[]  = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+static uint32_t Read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Deflate packs bits from the least significant end, except Huffman codes, which go most significant bit first
+class BitWriter
+{
+private:
+    std::string& out;
+    uint64_t bits = 0;
+    int count = 0;
+
+public:
+    explicit BitWriter(std::string& out) : out(out) {}
+
+    void Put(uint32_t value, int length)
+    {
+        bits |= (uint64_t)value << count;
+        count += length;
+        for (; count >= 8; count -= 8)
+        {
+            out += (char)(bits & 0xFF);
+            bits >>= 8;
+        }
+    }
+    void PutCode(uint32_t code, int length)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; ++i)
+        {
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        }
+        Put(reversed, length);
+    }
+    void Align()
+    {
+        if (count > 0)
+            Put(0, 8 - count);
+    }
+};
+
+static void PutSymbol(BitWriter& writer, uint32_t symbol)
+{
+    if      (symbol < 144) writer.PutCode(0x30 + symbol, 8);
+    else if (symbol < 256) writer.PutCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280) writer.PutCode(symbol - 256, 7);
+    else                   writer.PutCode(0xC0 + symbol - 280, 8);
+}
+
+static void PutMatch(BitWriter& writer, size_t length, size_t distance)
+{
+    size_t lengthCode = std::upper_bound(std::begin(g_lengthBase), std::end(g_lengthBase), length) - std::begin(g_lengthBase) - 1;
+    PutSymbol(writer, 257 + (uint32_t)lengthCode);
+    writer.Put((uint32_t)(length - g_lengthBase[lengthCode]), g_lengthExtra[lengthCode]);
+    size_t distanceCode = std::upper_bound(std::begin(g_distanceBase), std::end(g_distanceBase), distance) - std::begin(g_distanceBase) - 1;
+    writer.PutCode((uint32_t)distanceCode, 5);
+    writer.Put((uint32_t)(distance - g_distanceBase[distanceCode]), g_distanceExtra[distanceCode]);
+}
+
+// One fixed-code block followed by an empty stored block, which leaves the stream on a byte boundary
+// without ending it, so independently deflated pieces can simply be written one after another.
+// Matches never reach back past the start of src.
+static void DeflatePiece(const uint8_t* src, size_t size, std::string& out)
+{
+    constexpr int hashBits = 15;
+    std::vector<uint32_t> table(1 << hashBits, 0); // Position + 1 of the last sequence with each hash; 0 is empty
+    auto hash = [](uint32_t sequence) { return (sequence * 2654435761u) >> (32 - hashBits); };
+
+    BitWriter writer(out);
+    writer.Put(0, 1); // Not final
+    writer.Put(1, 2); // Fixed codes
+
+    size_t pos = 0;
+    while (pos + g_minMatch <= size)
+    {
+        uint32_t sequence = Read32(src + pos);
+        uint32_t& entry = table[hash(sequence)];
+        size_t candidate = entry;
+        entry = (uint32_t)(pos + 1);
+        if (candidate == 0 || pos + 1 - candidate > g_windowSize || Read32(src + candidate - 1) != sequence)
+        {
+            PutSymbol(writer, src[pos]);
+            ++pos;
+            continue;
+        }
+
+        --candidate;
+        size_t matchLength = g_minMatch;
+        size_t maxLength = std::min(g_maxMatch, size - pos);
+        while (matchLength < maxLength && src[candidate + matchLength] == src[pos + matchLength])
+        {
+            ++matchLength;
+        }
+        PutMatch(writer, matchLength, pos - candidate);
+        // Later runs find their nearest repeat instead of this match's start
+        for (size_t i = pos + 1; i < pos + matchLength && i + g_minMatch <= size; ++i)
+        {
+            table[hash(Read32(src + i))] = (uint32_t)(i + 1);
+        }
+        pos += matchLength;
+    }
+    for (; pos < size; ++pos)
+    {
+        PutSymbol(writer, src[pos]);
+    }
+    PutSymbol(writer, 256); // End of block
+
+    writer.Put(0, 3); // Empty stored block, not final
+    writer.Align();
+    out.append("\x00\x00\xFF\xFF", 4);
+}
+
+static uint32_t Adler32(const uint8_t* data, size_t size)
+{
+    uint32_t a = 1, b = 0;
+    while (size > 0)
+    {
+        size_t run = std::min<size_t>(size, 5552); // Longest run that can't overflow b before the modulo
+        for (size_t i = 0; i < run; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= g_adlerBase;
+        b %= g_adlerBase;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+// Checksum of two runs of data from the checksums of each, as in zlib's adler32_combine
+static uint32_t Adler32Combine(uint32_t first, uint32_t second, size_t secondSize)
+{
+    uint32_t remainder = (uint32_t)(secondSize % g_adlerBase);
+    uint32_t a1 = first & 0xFFFF;
+    uint32_t b = (uint32_t)(((uint64_t)remainder * a1) % g_adlerBase);
+    uint32_t a = a1 + (second & 0xFFFF) + g_adlerBase - 1;
+    b += (first >> 16) + (second >> 16) + g_adlerBase - remainder;
+    if (a >= g_adlerBase) a -= g_adlerBase;
+    if (a >= g_adlerBase) a -= g_adlerBase;
+    if (b >= g_adlerBase * 2) b -= g_adlerBase * 2;
+    if (b >= g_adlerBase) b -= g_adlerBase;
+    return (b << 16) | a;
+}
+
+static uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    static const std::array<uint32_t, 256> table = []
+    {
+        std::array<uint32_t, 256> table;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void WriteBigEndian(uint8_t* out, uint32_t value)
+{
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+}
+
+// Prefixes row with the filter (None, Sub or Up) whose output has the smallest sum of magnitudes, the usual PNG heuristic
+static void FilterRow(const uint8_t* row, const uint8_t* above, size_t rowBytes, uint8_t* out)
+{
+    constexpr size_t bpp = PngWriter::g_bytesPerPixel;
+    auto sub = [&](size_t i) { return (uint8_t)(row[i] - (i >= bpp ? row[i - bpp] : 0)); };
+    auto up  = [&](size_t i) { return (uint8_t)(row[i] - (above ? above[i] : 0)); };
+    auto cost = [](uint8_t value) { return (uint64_t)std::abs((int)(int8_t)value); };
+
+    uint64_t costNone = 0, costSub = 0, costUp = 0;
+    for (size_t i = 0; i < rowBytes; ++i)
+    {
+        costNone += cost(row[i]);
+        costSub += cost(sub(i));
+        costUp += cost(up(i));
+    }
+
+    if (costSub <= costNone && costSub <= costUp)
+    {
+        out[0] = 1;
+        for (size_t i = 0; i < rowBytes; ++i) out[1 + i] = sub(i);
+    }
+    else if (costUp <= costNone)
+    {
+        out[0] = 2;
+        for (size_t i = 0; i < rowBytes; ++i) out[1 + i] = up(i);
+    }
+    else
+    {
+        out[0] = 0;
+        memcpy(out + 1, row, rowBytes);
+    }
+}
+
+PngWriter::PngWriter(const std::string& filename, uint32_t width, uint32_t height) :
+    file(filename, std::ios::binary | std::ios::trunc), width(width), height(height)
+{
+    _ASSERT_EXPR(width > 0 && height > 0, L"PNG images can't be empty");
+    if (!file)
+        return;
+
+    constexpr uint8_t signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    file.write((const char*)signature, sizeof(signature));
+
+    uint8_t header[13] = {};
+    WriteBigEndian(header + 0, width);
+    WriteBigEndian(header + 4, height);
+    header[8] = 8; // Bits per channel
+    header[9] = 2; // RGB
+    WriteChunk("IHDR", header, sizeof(header));
+}
+PngWriter::~PngWriter() = default;
+
+bool PngWriter::IsOpen() const
+{
+    return file.is_open();
+}
+
+void PngWriter::WriteChunk(const char type[4], const uint8_t* data, size_t size)
+{
+    uint8_t prefix[8];
+    WriteBigEndian(prefix, (uint32_t)size);
+    memcpy(prefix + 4, type, 4);
+    uint32_t crc = Crc32(Crc32(0, prefix + 4, 4), data, size);
+    uint8_t suffix[4];
+    WriteBigEndian(suffix, crc);
+
+    file.write((const char*)prefix, sizeof(prefix));
+    file.write((const char*)data, size);
+    file.write((const char*)suffix, sizeof(suffix));
+}
+
+void PngWriter::WriteRows(const uint8_t* rows, uint32_t rowCount)
+{
+    _ASSERT_EXPR(rowsWritten + rowCount <= height, L"Wrote more rows than the image has");
+    const size_t rowBytes = (size_t)width * g_bytesPerPixel;
+    const size_t pieceCount = std::min<size_t>(rowCount, ParallelPieceCount(rowCount * rowBytes, 1 << 18));
+
+    struct Piece
+    {
+        std::string deflated;
+        uint32_t adler;
+        size_t size;
+    };
+    std::vector<Piece> pieces(pieceCount);
+    ParallelPieces(pieceCount, [&](size_t piece)
+    {
+        size_t begin = rowCount * piece / pieceCount;
+        size_t end = rowCount * (piece + 1) / pieceCount;
+        std::vector<uint8_t> filtered((end - begin) * (rowBytes + 1));
+        for (size_t row = begin; row < end; ++row)
+        {
+            const uint8_t* above = row > 0 ? rows + (row - 1) * rowBytes : (previousRow.empty() ? nullptr : previousRow.data());
+            FilterRow(rows + row * rowBytes, above, rowBytes, filtered.data() + (row - begin) * (rowBytes + 1));
+        }
+        pieces[piece].adler = Adler32(filtered.data(), filtered.size());
+        pieces[piece].size = filtered.size();
+        DeflatePiece(filtered.data(), filtered.size(), pieces[piece].deflated);
+    });
+
+    if (rowsWritten == 0 && !pieces.empty())
+        pieces[0].deflated.insert(0, "\x78\x01", 2); // zlib header: deflate with a 32K window, no dictionary
+
+    for (const Piece& piece : pieces)
+    {
+        adler = Adler32Combine(adler, piece.adler, piece.size);
+        WriteChunk("IDAT", (const uint8_t*)piece.deflated.data(), piece.deflated.size());
+    }
+
+    if (rowCount > 0)
+        previousRow.assign(rows + (rowCount - 1) * rowBytes, rows + rowCount * rowBytes);
+    rowsWritten += rowCount;
+}
+
+bool PngWriter::Finish()
+{
+    _ASSERT_EXPR(rowsWritten == height, L"Image finished before all of its rows were written");
+    // Empty final stored block, then the checksum of everything inflated
+    uint8_t tail[9] = { 0x01, 0x00, 0x00, 0xFF, 0xFF };
+    WriteBigEndian(tail + 5, adler);
+    WriteChunk("IDAT", tail, sizeof(tail));
+    WriteChunk("IEND", nullptr, 0);
+    file.close();
+    return !file.fail();
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 8-bit RGB PNG written a few rows at a time, so an image never has to be held in memory whole.
+// Each batch of rows is filtered and deflated in parallel pieces, each piece ending on a byte boundary,
+// and the pieces are written out as IDAT chunks in order.
+class PngWriter
+{
+public:
+    static constexpr int g_bytesPerPixel = 3;
+
+private:
+    std::ofstream file;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowsWritten = 0;
+    uint32_t adler = 1; // Of the whole zlib stream so far
+    std::vector<uint8_t> previousRow; // Unfiltered; the Up filter of the next batch's first row refers to it
+
+    void WriteChunk(const char type[4], const uint8_t* data, size_t size);
+
+public:
+    // Check IsOpen afterward
+    PngWriter(const std::string& filename, uint32_t width, uint32_t height);
+    ~PngWriter();
+
+    bool IsOpen() const;
+
+    // rows holds rowCount rows of width * g_bytesPerPixel bytes each, top to bottom
+    void WriteRows(const uint8_t* rows, uint32_t rowCount);
+    // Ends the image once every row has been written. Returns false if anything failed to write.
+    bool Finish();
+};
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include "HUtility.h"
+#include "MappedFile.h"
+#include "Compression.h"
+#include "GraphText.h"
+#include "GraphBinary.h"
+#include "Wire.h"
+#include "PngWriter.h"
+#include "Rasterizer.h"
+
+namespace raster
+{
+    constexpr int g_tileSize = 256; // Pixels across a tile, and the most rows in a band
+    constexpr size_t g_bandBytes = 32 << 20; // Very wide images get shorter bands to stay around this
+
+    static bool IsKnownGate(Gate gate)
+    {
+        switch (gate)
+        {
+        case Gate::OR: case Gate::NOR: case Gate::AND: case Gate::XOR:
+        case Gate::RESISTOR: case Gate::CAPACITOR: case Gate::LED: case Gate::DELAY:
+        case Gate::BATTERY:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Both formats refer to wire ends by node index
+    static bool BuildScene(const std::vector<SceneNode>& nodes, const std::vector<cg::Wire>& wires, Scene& scene)
+    {
+        std::vector<uint32_t> inputs(nodes.size(), 0);
+        std::vector<uint32_t> outputs(nodes.size(), 0);
+        scene.wires.reserve(wires.size());
+        for (const cg::Wire& wire : wires)
+        {
+            ++outputs[wire.start];
+            ++inputs[wire.end];
+            IVec2 start = nodes[wire.start].position;
+            IVec2 end = nodes[wire.end].position;
+            scene.wires.push_back({ start, Wire::GetLegalElbowPosition(start, end, wire.elbowConfig), end });
+        }
+        scene.nodes.reserve(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            if (!IsKnownGate(nodes[i].gate))
+                return false;
+            bool passthrough = nodes[i].gate == Gate::OR && inputs[i] == 1 && outputs[i] > 0; // Same test as Node::IsPassthrough
+            if (!passthrough)
+                scene.nodes.push_back(nodes[i]);
+        }
+        return true;
+    }
+
+    bool LoadScene(const std::string& filename, Scene& scene)
+    {
+        scene = Scene();
+        MappedFile file(filename);
+        if (!file.IsOpen())
+            return false;
+
+        std::string storage;
+        std::vector<SceneNode> nodes;
+        std::vector<cg::Wire> wires;
+        if (cgb::IsBinaryFilename(filename))
+        {
+            cgb::View view;
+            if (!view.Open(file, storage))
+                return false;
+            nodes.reserve(view.nodes.size());
+            for (const cgb::NodeRecord& node : view.nodes)
+            {
+                nodes.push_back({ IVec2(node.x, node.y), (Gate)node.gate, node.extraParam });
+            }
+            wires.reserve(view.wires.size());
+            for (const cgb::WireRecord& wire : view.wires)
+            {
+                wires.push_back({ (ElbowConfig)wire.elbowConfig, wire.start, wire.end });
+            }
+            for (const cgb::GroupRecord& group : view.groups)
+            {
+                scene.groups.push_back({ IRect(group.x, group.y, group.w, group.h), Color{ group.color[0], group.color[1], group.color[2], group.color[3] } });
+            }
+        }
+        else
+        {
+            std::string_view text;
+            uint8_t filter;
+            cg::Contents contents;
+            if (!compression::Unpack(file.View(), storage, text, filter) || !cg::Parse(text, contents))
+                return false;
+            nodes.reserve(contents.nodes.size());
+            for (const cg::Node& node : contents.nodes)
+            {
+                nodes.push_back({ node.position, node.gate, node.extraParam });
+            }
+            wires = std::move(contents.wires);
+            for (const GroupRecord& group : contents.groups)
+            {
+                scene.groups.push_back({ group.captureBounds, group.color });
+            }
+        }
+        return BuildScene(nodes, wires, scene);
+    }
+
+    struct Segment
+    {
+        IVec2 start;
+        IVec2 end;
+    };
+    struct Icon
+    {
+        IVec2 topLeft;
+        Gate gate;
+        uint8_t extraParam;
+    };
+    struct Frame
+    {
+        IRect bounds;
+        Color color;
+    };
+    // Pixels something covers, max inclusive
+    struct Span
+    {
+        int x0, y0, x1, y1;
+    };
+
+    // Everything in the scene in image pixels, bucketed by the bands and then the tiles each thing overlaps
+    struct Buckets
+    {
+        std::vector<std::vector<uint32_t>> frames;
+        std::vector<std::vector<uint32_t>> segments;
+        std::vector<std::vector<uint32_t>> icons;
+
+        explicit Buckets(size_t count) : frames(count), segments(count), icons(count) {}
+    };
+
+    // A tile's pixels within the band buffer
+    struct Tile
+    {
+        uint8_t* pixels; // Top-left of the tile
+        size_t stride;
+        IRect bounds; // In image pixels
+
+        uint8_t* At(int x, int y) const
+        {
+            return pixels + (size_t)(y - bounds.y) * stride + (size_t)(x - bounds.x) * PngWriter::g_bytesPerPixel;
+        }
+    };
+
+    static void Blend(uint8_t* pixel, Color color, uint32_t alpha)
+    {
+        if (alpha == 0)
+            return;
+        pixel[0] = (uint8_t)((color.r * alpha + pixel[0] * (255 - alpha) + 127) / 255);
+        pixel[1] = (uint8_t)((color.g * alpha + pixel[1] * (255 - alpha) + 127) / 255);
+        pixel[2] = (uint8_t)((color.b * alpha + pixel[2] * (255 - alpha) + 127) / 255);
+    }
+
+    static void FillRect(const Tile& tile, IRect rect, Color color, uint32_t alpha)
+    {
+        int x0 = std::max(rect.x, tile.bounds.x);
+        int y0 = std::max(rect.y, tile.bounds.y);
+        int x1 = std::min(rect.x + rect.w, tile.bounds.x + tile.bounds.w);
+        int y1 = std::min(rect.y + rect.h, tile.bounds.y + tile.bounds.h);
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = x0; x < x1; ++x)
+            {
+                Blend(tile.At(x, y), color, alpha);
+            }
+        }
+    }
+
+    // Wires only ever run straight or at 45 degrees, so each step moves exactly one pixel along every axis that changes,
+    // and clipping to the tile is just narrowing the range of steps
+    static void DrawSegment(const Tile& tile, IVec2 start, IVec2 end, Color color)
+    {
+        IVec2 step((end.x > start.x) - (end.x < start.x), (end.y > start.y) - (end.y < start.y));
+        int first = 0;
+        int last = std::max(abs(end.x - start.x), abs(end.y - start.y));
+        auto clip = [&](int from, int direction, int min, int max) // max is exclusive
+        {
+            if (direction == 0)
+            {
+                if (from < min || from >= max)
+                    last = -1;
+                return;
+            }
+            first = std::max(first, direction > 0 ? min - from : from - (max - 1));
+            last = std::min(last, direction > 0 ? max - 1 - from : from - min);
+        };
+        clip(start.x, step.x, tile.bounds.x, tile.bounds.x + tile.bounds.w);
+        clip(start.y, step.y, tile.bounds.y, tile.bounds.y + tile.bounds.h);
+        for (int i = first; i <= last; ++i)
+        {
+            Blend(tile.At(start.x + step.x * i, start.y + step.y * i), color, color.a);
+        }
+    }
+
+    // Tinted by multiplying, as the GPU does with the same sheets
+    static void DrawIcon(const Tile& tile, const Image& sheet, IVec2 cell, IVec2 topLeft, Color tint)
+    {
+        const int size = sheet.width / 4;
+        const uint8_t* texels = (const uint8_t*)sheet.data;
+        int x0 = std::max(topLeft.x, tile.bounds.x);
+        int y0 = std::max(topLeft.y, tile.bounds.y);
+        int x1 = std::min(topLeft.x + size, tile.bounds.x + tile.bounds.w);
+        int y1 = std::min(topLeft.y + size, tile.bounds.y + tile.bounds.h);
+        for (int y = y0; y < y1; ++y)
+        {
+            const uint8_t* texel = texels + ((size_t)(cell.y * size + y - topLeft.y) * sheet.width + (size_t)(cell.x * size + x0 - topLeft.x)) * 4;
+            for (int x = x0; x < x1; ++x, texel += 4)
+            {
+                Color color{ (uint8_t)(texel[0] * tint.r / 255), (uint8_t)(texel[1] * tint.g / 255), (uint8_t)(texel[2] * tint.b / 255), 255 };
+                Blend(tile.At(x, y), color, texel[3] * tint.a / 255);
+            }
+        }
+    }
+
+    bool Render(const Scene& scene, const std::string& filename, const Options& options)
+    {
+        _ASSERT_EXPR(options.pixelsPerUnit == 1 || options.pixelsPerUnit == 2 || options.pixelsPerUnit == 4, L"Node icons only come in 8x, 16x and 32x");
+        const int scale = options.pixelsPerUnit;
+        const int iconSize = g_gridSize * scale;
+
+        // Extents in units, max exclusive, with a grid space of margin
+        int64_t minX = INT64_MAX, minY = INT64_MAX, maxX = INT64_MIN, maxY = INT64_MIN;
+        auto include = [&](int64_t x0, int64_t y0, int64_t x1, int64_t y1)
+        {
+            minX = std::min(minX, x0);
+            minY = std::min(minY, y0);
+            maxX = std::max(maxX, x1);
+            maxY = std::max(maxY, y1);
+        };
+        for (const SceneNode& node : scene.nodes)
+        {
+            include((int64_t)node.position.x - g_gridSize / 2, (int64_t)node.position.y - g_gridSize / 2, (int64_t)node.position.x + g_gridSize / 2, (int64_t)node.position.y + g_gridSize / 2);
+        }
+        for (const SceneWire& wire : scene.wires)
+        {
+            for (IVec2 point : { wire.start, wire.elbow, wire.end })
+            {
+                include(point.x, point.y, (int64_t)point.x + 1, (int64_t)point.y + 1);
+            }
+        }
+        for (const SceneGroup& group : scene.groups)
+        {
+            include(group.bounds.x, group.bounds.y, (int64_t)group.bounds.x + group.bounds.w, (int64_t)group.bounds.y + group.bounds.h);
+        }
+        if (minX > maxX)
+            return false;
+        minX -= g_gridSize;
+        minY -= g_gridSize;
+        maxX += g_gridSize;
+        maxY += g_gridSize;
+
+        const int64_t width = (maxX - minX) * scale;
+        const int64_t height = (maxY - minY) * scale;
+        if (width > INT_MAX || height > INT_MAX)
+            return false;
+        auto toPixels = [&](IVec2 point) { return IVec2((int)((point.x - minX) * scale), (int)((point.y - minY) * scale)); };
+
+        std::vector<Frame> frames;
+        frames.reserve(scene.groups.size());
+        for (const SceneGroup& group : scene.groups)
+        {
+            frames.push_back({ IRect(toPixels(group.bounds.xy), group.bounds.w * scale, group.bounds.h * scale), group.color });
+        }
+        std::vector<Segment> segments;
+        segments.reserve(scene.wires.size() * 2);
+        for (const SceneWire& wire : scene.wires)
+        {
+            segments.push_back({ toPixels(wire.start), toPixels(wire.elbow) });
+            segments.push_back({ toPixels(wire.elbow), toPixels(wire.end) });
+        }
+        std::vector<Icon> icons;
+        icons.reserve(scene.nodes.size());
+        for (const SceneNode& node : scene.nodes)
+        {
+            icons.push_back({ toPixels(node.position - IVec2(g_gridSize / 2)), node.gate, node.extraParam });
+        }
+
+        auto frameSpan = [&](uint32_t i) { const IRect& r = frames[i].bounds; return Span{ r.x, r.y, r.x + r.w - 1, r.y + r.h - 1 }; };
+        auto segmentSpan = [&](uint32_t i)
+        {
+            const Segment& s = segments[i];
+            return Span{ std::min(s.start.x, s.end.x), std::min(s.start.y, s.end.y), std::max(s.start.x, s.end.x), std::max(s.start.y, s.end.y) };
+        };
+        auto iconSpan = [&](uint32_t i) { IVec2 p = icons[i].topLeft; return Span{ p.x, p.y, p.x + iconSize - 1, p.y + iconSize - 1 }; };
+
+        const size_t rowBytes = (size_t)width * PngWriter::g_bytesPerPixel;
+        const int bandRows = (int)std::clamp<size_t>(g_bandBytes / rowBytes, 1, g_tileSize);
+        const size_t bandCount = (size_t)((height + bandRows - 1) / bandRows);
+        const size_t columnCount = (size_t)((width + g_tileSize - 1) / g_tileSize);
+
+        auto bucket = [](std::vector<std::vector<uint32_t>>& buckets, uint32_t i, int from, int to, int size)
+        {
+            for (int b = from / size; b <= to / size && b < (int)buckets.size(); ++b)
+            {
+                buckets[b].push_back(i);
+            }
+        };
+        Buckets bands(bandCount);
+        for (uint32_t i = 0; i < frames.size(); ++i)   { Span s = frameSpan(i);   bucket(bands.frames, i, s.y0, s.y1, bandRows); }
+        for (uint32_t i = 0; i < segments.size(); ++i) { Span s = segmentSpan(i); bucket(bands.segments, i, s.y0, s.y1, bandRows); }
+        for (uint32_t i = 0; i < icons.size(); ++i)    { Span s = iconSpan(i);    bucket(bands.icons, i, s.y0, s.y1, bandRows); }
+
+        const Image sheets[3] =
+        {
+            NodeIconSheet(NodeIconType::Background, scale),
+            NodeIconSheet(NodeIconType::Basic, scale),
+            NodeIconSheet(NodeIconType::NTD, scale),
+        };
+
+        PngWriter writer(filename, (uint32_t)width, (uint32_t)height);
+        if (!writer.IsOpen())
+            return false;
+
+        std::vector<uint8_t> band(rowBytes * bandRows);
+        for (size_t b = 0; b < bandCount; ++b)
+        {
+            const int bandY = (int)(b * bandRows);
+            const int rows = (int)std::min<int64_t>(bandRows, height - bandY);
+
+            Buckets columns(columnCount);
+            for (uint32_t i : bands.frames[b])   { Span s = frameSpan(i);   bucket(columns.frames, i, s.x0, s.x1, g_tileSize); }
+            for (uint32_t i : bands.segments[b]) { Span s = segmentSpan(i); bucket(columns.segments, i, s.x0, s.x1, g_tileSize); }
+            for (uint32_t i : bands.icons[b])    { Span s = iconSpan(i);    bucket(columns.icons, i, s.x0, s.x1, g_tileSize); }
+            // Nothing outlives its band
+            bands.frames[b] = {};
+            bands.segments[b] = {};
+            bands.icons[b] = {};
+
+            // Tiles are handed out one at a time, since some are far busier than others
+            std::atomic_size_t nextColumn = 0;
+            ParallelPieces(ParallelPieceCount(columnCount, 1), [&](size_t)
+            {
+                for (size_t c; (c = nextColumn++) < columnCount;)
+                {
+                    Tile tile;
+                    tile.bounds = IRect((int)c * g_tileSize, bandY, (int)std::min<int64_t>(g_tileSize, width - (int64_t)c * g_tileSize), rows);
+                    tile.stride = rowBytes;
+                    tile.pixels = band.data() + (size_t)tile.bounds.x * PngWriter::g_bytesPerPixel;
+
+                    for (int y = 0; y < rows; ++y)
+                    {
+                        uint8_t* pixel = tile.pixels + (size_t)y * rowBytes;
+                        for (int x = 0; x < tile.bounds.w; ++x, pixel += PngWriter::g_bytesPerPixel)
+                        {
+                            pixel[0] = options.background.r;
+                            pixel[1] = options.background.g;
+                            pixel[2] = options.background.b;
+                        }
+                    }
+
+                    // Same order and colors as the editor draws them, with nothing powered
+                    for (uint32_t i : columns.frames[c])
+                    {
+                        const Frame& frame = frames[i];
+                        const IRect& r = frame.bounds;
+                        FillRect(tile, r, frame.color, (frame.color.a + 2) / 4);
+                        FillRect(tile, IRect(r.x, r.y, r.w, 1), frame.color, frame.color.a);
+                        FillRect(tile, IRect(r.x, r.y + r.h - 1, r.w, 1), frame.color, frame.color.a);
+                        FillRect(tile, IRect(r.x, r.y, 1, r.h), frame.color, frame.color.a);
+                        FillRect(tile, IRect(r.x + r.w - 1, r.y, 1, r.h), frame.color, frame.color.a);
+                    }
+                    for (uint32_t i : columns.segments[c])
+                    {
+                        DrawSegment(tile, segments[i].start, segments[i].end, options.wire);
+                    }
+                    for (uint32_t i : columns.icons[c])
+                    {
+                        const Icon& icon = icons[i];
+                        IVec2 cell = NodeIconSheetPos(icon.gate);
+                        DrawIcon(tile, sheets[0], cell, icon.topLeft, options.background);
+                        DrawIcon(tile, sheets[1], cell, icon.topLeft, options.node);
+                        switch (icon.gate)
+                        {
+                        case Gate::RESISTOR:
+                        case Gate::LED:
+                            DrawIcon(tile, sheets[2], cell, icon.topLeft, Node::g_resistanceBands[std::min<uint8_t>(icon.extraParam, 9)]);
+                            break;
+                        case Gate::CAPACITOR: // Uncharged
+                            DrawIcon(tile, sheets[2], cell, icon.topLeft, options.node);
+                            break;
+                        default:
+                            break;
+                        }
+                    }
+                }
+            });
+
+            writer.WriteRows(band.data(), (uint32_t)rows);
+        }
+        return writer.Finish();
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <raylib.h>
+#include "IVec.h"
+#include "Node.h"
+#include "UIColors.h"
+
+// Headless renderer for whole boards, at sizes far past what a window or texture could hold.
+// Draws on the CPU with the editor's icon art and wire geometry, in tiles spread across every core,
+// and streams each finished band of tiles into a PNG, so memory use follows the board's width rather than its area.
+namespace raster
+{
+    struct SceneNode
+    {
+        IVec2 position;
+        Gate gate;
+        uint8_t extraParam;
+    };
+
+    struct SceneWire
+    {
+        IVec2 start;
+        IVec2 elbow;
+        IVec2 end;
+    };
+
+    struct SceneGroup
+    {
+        IRect bounds;
+        Color color;
+    };
+
+    // What gets drawn of a graph, without the graph; nodes the editor hides as passthroughs are left out
+    struct Scene
+    {
+        std::vector<SceneNode> nodes;
+        std::vector<SceneWire> wires;
+        std::vector<SceneGroup> groups;
+    };
+
+    struct Options
+    {
+        int pixelsPerUnit = 1; // 1, 2 or 4, matching the icon sheets; a grid space is 8 units
+        Color background = BLACK;
+        Color wire = ui_color::DEADCABLE;
+        Color node = WHITE;
+    };
+
+    // Reads a saved graph, text or binary, compressed or not. Returns false if it's missing or malformed.
+    bool LoadScene(const std::string& filename, Scene& scene);
+    // Returns false if the scene is empty, too large for a PNG, or the file can't be written
+    bool Render(const Scene& scene, const std::string& filename, const Options& options);
+}
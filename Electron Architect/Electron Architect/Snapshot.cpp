@@ -0,0 +1,255 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "Snapshot.h"
+#include "GraphBinary.h"
+#include "GraphText.h"
+#include "Compression.h"
+
+// Written beside the target and swapped in, so a crash or failed write mid-save never replaces the last good file
+static bool WriteReplacing(const std::string& filename, std::string_view data, bool binary)
+{
+    const std::string tempFilename = filename + ".tmp";
+    std::ofstream file(tempFilename, std::fstream::out | std::fstream::trunc | (binary ? std::fstream::binary : std::fstream::openmode()));
+    file.write(data.data(), data.size());
+    file.close();
+
+    std::error_code error;
+    if (file.good())
+    {
+        std::filesystem::rename(tempFilename, filename, error);
+        if (!error)
+            return true;
+    }
+    std::filesystem::remove(tempFilename, error);
+    return false;
+}
+
+bool GraphSnapshot::Save(const std::string& filename, bool compress) const
+{
+    if (cgb::IsBinaryFilename(filename))
+        return SaveBinary(filename, compress);
+
+    // Formatted in memory and written in one go; TextFormat would share its buffers with the main thread anyway
+    std::string text;
+    cg::Write(*this, text);
+
+    if (compress)
+    {
+        std::string packed;
+        compression::Compress(text, packed);
+        return WriteReplacing(filename, packed, true);
+    }
+    else
+    {
+        return WriteReplacing(filename, text, false);
+    }
+}
+
+bool GraphSnapshot::LoadCheckpoint(const std::string& filename)
+{
+    if (cgb::IsBinaryFilename(filename))
+        return LoadCheckpointBinary(filename);
+
+    MappedFile file(filename);
+    std::string unpacked;
+    std::string_view text;
+    uint8_t filter;
+    cg::Contents contents;
+    // Without the handle section there's nothing a journal could be replayed against
+    if (!file.IsOpen() || !compression::Unpack(file.View(), unpacked, text, filter) ||
+        !cg::Parse(text, contents) || contents.version != 1.3 || contents.generation == 0)
+        return false;
+
+    NodeHandle handleCount = 0;
+    for (NodeHandle handle : contents.handles)
+    {
+        handleCount = std::max(handleCount, handle + 1);
+    }
+    uint32_t slotCount = 0;
+    for (uint32_t slot : contents.slots)
+    {
+        slotCount = std::max(slotCount, slot + 1);
+    }
+
+    nodes.Clear();
+    nodes.Grow(handleCount);
+    for (size_t i = 0; i < contents.nodes.size(); ++i)
+    {
+        const cg::Node& parsed = contents.nodes[i];
+        NodeRecord& node = nodes.Edit(contents.handles[i]);
+        node.live = true;
+        node.gate = parsed.gate;
+        node.extraParam = parsed.extraParam;
+        node.position = parsed.position;
+        node.name = parsed.name;
+    }
+    wires.Clear();
+    wires.Grow(slotCount);
+    for (size_t i = 0; i < contents.wires.size(); ++i)
+    {
+        // Wires refer to nodes by file order; journals refer to them by handle
+        const cg::Wire& parsed = contents.wires[i];
+        WireRecord& wire = wires.Edit(contents.slots[i]);
+        wire.live = true;
+        wire.elbowConfig = parsed.elbowConfig;
+        wire.start = contents.handles[parsed.start];
+        wire.end = contents.handles[parsed.end];
+    }
+    groups = std::move(contents.groups);
+    generation = contents.generation;
+    return true;
+}
+
+bool GraphSnapshot::SaveBinary(const std::string& filename, bool compress) const
+{
+    std::vector<uint32_t> nodeIDs(nodes.Size());
+    uint32_t nodeCount = 0;
+    for (size_t handle = 0; handle < nodes.Size(); ++handle)
+    {
+        if (nodes[handle].live)
+            nodeIDs[handle] = nodeCount++;
+    }
+    uint32_t wireCount = 0;
+    for (size_t i = 0; i < wires.Size(); ++i)
+    {
+        if (wires[i].live)
+            ++wireCount;
+    }
+
+    auto alignSection = [](uint64_t offset) { return (offset + 7) & ~(uint64_t)7; };
+    cgb::Header header = {};
+    memcpy(header.magic, cgb::g_magic, sizeof(cgb::g_magic));
+    header.version = cgb::g_version;
+    header.generation = generation;
+    header.nodeCount = nodeCount;
+    header.wireCount = wireCount;
+    header.groupCount = (uint32_t)groups.size();
+    header.nodeOffset = alignSection(sizeof(cgb::Header));
+    header.wireOffset = alignSection(header.nodeOffset + (uint64_t)nodeCount * sizeof(cgb::NodeRecord));
+    header.groupOffset = alignSection(header.wireOffset + (uint64_t)wireCount * sizeof(cgb::WireRecord));
+    header.stringOffset = alignSection(header.groupOffset + groups.size() * sizeof(cgb::GroupRecord));
+
+    // Laid out in memory exactly as on disk, then written in one go
+    std::string strings;
+    auto addString = [&strings](const std::string& str)
+    {
+        cgb::StringRef ref = { (uint32_t)strings.size(), (uint32_t)str.size() };
+        strings += str;
+        return ref;
+    };
+    std::vector<char> buffer(header.stringOffset);
+    cgb::NodeRecord* nodeData = reinterpret_cast<cgb::NodeRecord*>(buffer.data() + header.nodeOffset);
+    for (size_t handle = 0; handle < nodes.Size(); ++handle)
+    {
+        const NodeRecord& node = nodes[handle];
+        if (!node.live)
+            continue;
+
+        cgb::NodeRecord& record = *nodeData++;
+        record.x = node.position.x;
+        record.y = node.position.y;
+        record.gate = (uint8_t)node.gate;
+        record.extraParam = node.extraParam;
+        record.handle = (uint32_t)handle;
+        record.name = addString(node.name);
+    }
+    cgb::WireRecord* wireData = reinterpret_cast<cgb::WireRecord*>(buffer.data() + header.wireOffset);
+    for (size_t i = 0; i < wires.Size(); ++i)
+    {
+        const WireRecord& wire = wires[i];
+        if (!wire.live)
+            continue;
+
+        cgb::WireRecord& record = *wireData++;
+        record.start = nodeIDs[wire.start];
+        record.end = nodeIDs[wire.end];
+        record.slot = (uint32_t)i;
+        record.elbowConfig = (uint8_t)wire.elbowConfig;
+    }
+    cgb::GroupRecord* groupData = reinterpret_cast<cgb::GroupRecord*>(buffer.data() + header.groupOffset);
+    for (const GroupRecord& group : groups)
+    {
+        cgb::GroupRecord& record = *groupData++;
+        record.x = group.captureBounds.x;
+        record.y = group.captureBounds.y;
+        record.w = group.captureBounds.w;
+        record.h = group.captureBounds.h;
+        record.color[0] = group.color.r;
+        record.color[1] = group.color.g;
+        record.color[2] = group.color.b;
+        record.color[3] = group.color.a;
+        record.label = addString(group.label);
+    }
+    header.stringSize = strings.size();
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    buffer.insert(buffer.end(), strings.begin(), strings.end());
+
+    if (compress)
+    {
+        std::string image(buffer.begin(), buffer.end());
+        cgb::DeltaEncode(image);
+        std::string packed;
+        compression::Compress(image, packed, cgb::g_deltaFilter);
+        return WriteReplacing(filename, packed, true);
+    }
+    else
+    {
+        return WriteReplacing(filename, std::string_view(buffer.data(), buffer.size()), true);
+    }
+}
+
+bool GraphSnapshot::LoadCheckpointBinary(const std::string& filename)
+{
+    MappedFile file(filename);
+    std::string unpacked;
+    cgb::View view;
+    if (!file.IsOpen() || !view.Open(file, unpacked) || view.generation == 0)
+        return false;
+
+    NodeHandle handleCount = 0;
+    for (const cgb::NodeRecord& node : view.nodes)
+    {
+        handleCount = std::max(handleCount, (NodeHandle)node.handle + 1);
+    }
+    uint32_t slotCount = 0;
+    for (const cgb::WireRecord& wire : view.wires)
+    {
+        slotCount = std::max(slotCount, wire.slot + 1);
+    }
+
+    nodes.Clear();
+    nodes.Grow(handleCount);
+    for (const cgb::NodeRecord& record : view.nodes)
+    {
+        NodeRecord& node = nodes.Edit(record.handle);
+        node.live = true;
+        node.gate = (Gate)record.gate;
+        node.extraParam = record.extraParam;
+        node.position = IVec2(record.x, record.y);
+        node.name = view.String(record.name);
+    }
+    wires.Clear();
+    wires.Grow(slotCount);
+    for (const cgb::WireRecord& record : view.wires)
+    {
+        // Wires refer to nodes by file order; journals refer to them by handle
+        WireRecord& wire = wires.Edit(record.slot);
+        wire.live = true;
+        wire.elbowConfig = (ElbowConfig)record.elbowConfig;
+        wire.start = view.nodes[record.start].handle;
+        wire.end = view.nodes[record.end].handle;
+    }
+    groups.clear();
+    groups.reserve(view.groups.size());
+    for (const cgb::GroupRecord& record : view.groups)
+    {
+        groups.push_back({
+            IRect(record.x, record.y, record.w, record.h),
+            { record.color[0], record.color[1], record.color[2], record.color[3] },
+            std::string(view.String(record.label)) });
+    }
+    generation = view.generation;
+    return true;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "HUtility.h"
+#include "IVec.h"
+#include "Node.h"
+#include "Wire.h"
+
+// Array split into fixed-size chunks which are shared between copies.
+// Copying only copies a pointer; the chunk table and each chunk are cloned the first time they are written to while shared.
+template<typename T>
+class CowArray
+{
+public:
+    static constexpr size_t g_chunkSize = 1024;
+
+private:
+    using Chunk = std::array<T, g_chunkSize>;
+    using Table = std::vector<std::shared_ptr<Chunk>>;
+
+    std::shared_ptr<Table> table = std::make_shared<Table>();
+    size_t count = 0;
+
+    // Only the thread that owns the live copy ever writes, so a use count of 1 means nobody else can be reading.
+    // The fence pairs with the release in the reader's shared_ptr destructor.
+    template<typename Ptr>
+    static bool IsUnique(const Ptr& ptr)
+    {
+        if (ptr.use_count() != 1)
+            return false;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    Table& EditableTable()
+    {
+        if (!IsUnique(table))
+            table = std::make_shared<Table>(*table);
+        return *table;
+    }
+
+public:
+    size_t Size() const
+    {
+        return count;
+    }
+
+    const T& operator[](size_t index) const
+    {
+        _ASSERT_EXPR(index < count, L"Index out of range");
+        return (*(*table)[index / g_chunkSize])[index % g_chunkSize];
+    }
+
+    T& Edit(size_t index)
+    {
+        _ASSERT_EXPR(index < count, L"Index out of range");
+        std::shared_ptr<Chunk>& chunk = EditableTable()[index / g_chunkSize];
+        if (!IsUnique(chunk))
+            chunk = std::make_shared<Chunk>(*chunk);
+        return (*chunk)[index % g_chunkSize];
+    }
+
+    // Only grows; new elements are default constructed
+    void Grow(size_t size)
+    {
+        _ASSERT_EXPR(size >= count, L"CowArray cannot shrink");
+        size_t chunkCount = (size + g_chunkSize - 1) / g_chunkSize;
+        if (chunkCount > table->size())
+        {
+            Table& editable = EditableTable();
+            while (editable.size() < chunkCount)
+            {
+                editable.push_back(std::make_shared<Chunk>());
+            }
+        }
+        count = size;
+    }
+
+    void Clear()
+    {
+        table = std::make_shared<Table>();
+        count = 0;
+    }
+};
+
+// Plain-data copy of a node, indexed by NodeHandle
+struct NodeRecord
+{
+    bool live = false;
+    Gate gate = Gate::OR;
+    uint8_t extraParam = 0;
+    IVec2 position = IVec2::Zero();
+    std::string name;
+};
+
+// Plain-data copy of a wire, indexed by Wire::recordIndex
+struct WireRecord
+{
+    bool live = false;
+    ElbowConfig elbowConfig = ElbowConfig::horizontal;
+    NodeHandle start = 0;
+    NodeHandle end = 0;
+};
+
+struct GroupRecord
+{
+    IRect captureBounds = IRect(0);
+    Color color = {};
+    std::string label;
+};
+inline bool operator==(const GroupRecord& a, const GroupRecord& b)
+{
+    return
+        a.captureBounds.x == b.captureBounds.x && a.captureBounds.y == b.captureBounds.y &&
+        a.captureBounds.w == b.captureBounds.w && a.captureBounds.h == b.captureBounds.h &&
+        a.color.r == b.color.r && a.color.g == b.color.g && a.color.b == b.color.b && a.color.a == b.color.a &&
+        a.label == b.label;
+}
+
+// Immutable view of a graph at one moment; safe to hand to another thread while the graph keeps being edited
+struct GraphSnapshot
+{
+    CowArray<NodeRecord> nodes;
+    CowArray<WireRecord> wires;
+    std::vector<GroupRecord> groups; // Few enough to just copy
+    uint32_t generation = 0; // Journal generation this is a checkpoint for; 0 if it isn't one
+
+    // Writes the same format as Graph::Save: binary for .cgb files, text otherwise. Does not log, so it can run off the main thread.
+    // Text checkpoints also get a trailing handle section, which older versions ignore.
+    // Compressed files are wrapped in a compression container, which every loader unpacks transparently.
+    // Returns false if the file couldn't be written, leaving whatever was there before untouched.
+    bool Save(const std::string& filename, bool compress = false) const;
+    // Reads a checkpoint written by Save, keeping the handles journals refer to.
+    // Returns false if the file is missing, malformed, or not a checkpoint.
+    bool LoadCheckpoint(const std::string& filename);
+
+private:
+    bool SaveBinary(const std::string& filename, bool compress) const;
+    bool LoadCheckpointBinary(const std::string& filename);
+};
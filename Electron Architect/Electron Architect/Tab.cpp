@@ -1,5 +1,5 @@
 #include <raylib.h>
-#include <thread>
+#include <cmath>
 #include <string>
 #include "IVec.h"
 #include "Graph.h"
@@ -17,6 +17,41 @@ Tab::~Tab()
 	delete graph;
 }
 
+bool Tab::IsSelected(const Node* node) const
+{
+	return node->GetHandle() < selectionMembership.size() && selectionMembership[node->GetHandle()];
+}
+void Tab::Select(Node* node)
+{
+	if (node->GetHandle() >= selectionMembership.size())
+		selectionMembership.resize(node->GetHandle() + 1, false);
+	if (selectionMembership[node->GetHandle()])
+		return;
+	selectionMembership[node->GetHandle()] = true;
+	selection.push_back(node);
+}
+void Tab::Select(const std::vector<Node*>& nodes)
+{
+	selection.reserve(selection.size() + nodes.size());
+	for (Node* node : nodes)
+	{
+		Select(node);
+	}
+}
+void Tab::DeselectNodes()
+{
+	// The selected nodes may already be destroyed, so the bits are cleared without looking at them
+	selectionMembership.assign(selectionMembership.size(), false);
+	selection.clear();
+}
+void Tab::SelectNodesInRecs()
+{
+	DeselectNodes();
+	std::vector<Node*> found;
+	graph->FindNodesInMultiRect(found, selectionRecs);
+	Select(found);
+}
+
 void Tab::UpdateBridgeCache()
 {
 	bridgeCache.clear();
@@ -28,34 +63,42 @@ void Tab::UpdateBridgeCache()
 
 	owningWindow->Log(LogType::attempt, "Updating bridge cache");
 
-	std::vector<size_t> cacheSizes;
-	cacheSizes.resize(selectionRecs.size(), 0);
-	// Cache size counting
+	// Each selected node belongs to the first rectangle holding it; only the nodes inside each rectangle are visited
+	std::vector<std::vector<Node*>> partitions(selectionRecs.size());
 	{
-		size_t halfSelectionSize = selection.size() / 2;
-		for (Node* node : selection)
+		std::vector<Node*> found;
+		for (size_t i = 0; i < selectionRecs.size(); ++i)
 		{
-			for (size_t i = 0; i < selectionRecs.size(); ++i)
+			found.clear();
+			graph->FindNodesInRect(found, ExpandIRect(selectionRecs[i])); // FindNodesInRect excludes the edges; InBoundingBox doesn't
+			for (Node* node : found)
 			{
-				if (InBoundingBox(selectionRecs[i], node->GetPosition()))
+				if (!IsSelected(node))
+					continue;
+				bool claimed = false;
+				for (size_t j = 0; j < i && !claimed; ++j)
 				{
-					++cacheSizes[i];
-					break;
+					claimed = InBoundingBox(selectionRecs[j], node->GetPosition());
 				}
+				if (!claimed)
+					partitions[i].push_back(node);
 			}
 		}
+	}
 
-		if (cacheSizes[0] == 1)
+	// Bridge type
+	{
+		if (partitions[0].size() == 1)
 			cachedBridgeType = WireBridgeType::one_to_many;
-		else if (cacheSizes.back() == 1)
+		else if (partitions.back().size() == 1)
 			cachedBridgeType = WireBridgeType::many_to_one;
 		else
 		{
-			size_t size1 = cacheSizes[0];
+			size_t size1 = partitions[0].size();
 			bool invalid = false;
-			for (size_t size : cacheSizes)
+			for (const std::vector<Node*>& partition : partitions)
 			{
-				if (size != size1)
+				if (partition.size() != size1)
 				{
 					invalid = true;
 					break;
@@ -64,9 +107,9 @@ void Tab::UpdateBridgeCache()
 			if (invalid)
 			{
 				owningWindow->Log(LogType::success, "No bridge can be made.");
-				for (size_t i = 0; i < cacheSizes.size(); ++i)
+				for (size_t i = 0; i < partitions.size(); ++i)
 				{
-					owningWindow->Log(LogType::info, "Selection " + std::to_string(i) + " size = " + std::to_string(cacheSizes[i]));
+					owningWindow->Log(LogType::info, "Selection {} size = {}", i, partitions[i].size());
 				}
 				return;
 			}
@@ -77,45 +120,15 @@ void Tab::UpdateBridgeCache()
 
 	// Produce cache
 	{
-		bridgeCache.reserve(cacheSizes.size());
-
-		for (size_t i = 0; i < cacheSizes.size(); ++i)
-		{
-			bridgeCache.push_back({});
-			bridgeCache[i].reserve(cacheSizes[i]);
-		}
-
-		for (Node* node : selection)
+		for (std::vector<Node*>& partition : partitions)
 		{
-			for (size_t i = 0; i < selectionRecs.size(); ++i)
-			{
-				if (InBoundingBox(selectionRecs[i], node->GetPosition()))
-				{
-					bridgeCache[i].push_back(node);
-					break;
-				}
-			}
-		}
-
-		auto sortNodes = [](std::vector<Node*>& nodeVec) {
-			std::sort(nodeVec.begin(), nodeVec.end(),
+			std::sort(partition.begin(), partition.end(),
 				[](Node* a, Node* b)
 				{
 					return (a->GetX() != b->GetX() ? a->GetX() < b->GetX() : a->GetY() < b->GetY());
 				});
-		};
-
-		std::vector<std::thread> sorterThreads;
-		sorterThreads.reserve(bridgeCache.size());
-		for (size_t i = 0; i < bridgeCache.size(); ++i)
-		{
-			sorterThreads.emplace_back(sortNodes, std::ref(bridgeCache[i]));
 		}
-		for (size_t i = 0; i < bridgeCache.size(); ++i)
-		{
-			sorterThreads[i].join();
-		}
-		sorterThreads.clear();
+		bridgeCache = std::move(partitions);
 	}
 	owningWindow->Log(LogType::success, "Bridge cache updated and valid");
 }
@@ -124,6 +137,8 @@ void Tab::BridgeSelection(ElbowConfig elbow)
 {
 	_ASSERT_EXPR(IsSelectionBridgeable(), L"Selection is not bridgable");
 
+	std::vector<std::pair<Node*, Node*>> connections;
+
 	switch (cachedBridgeType)
 	{
 	default:
@@ -136,7 +151,7 @@ void Tab::BridgeSelection(ElbowConfig elbow)
 		{
 			for (size_t j = 0; j < bridgeCache[i].size(); ++j)
 			{
-				graph->CreateWire(bridgeCache[0].back(), bridgeCache[i][j], elbow);
+				connections.emplace_back(bridgeCache[0].back(), bridgeCache[i][j]);
 			}
 		}
 		break;
@@ -146,7 +161,7 @@ void Tab::BridgeSelection(ElbowConfig elbow)
 		{
 			for (size_t j = 0; j < bridgeCache[i].size(); ++j)
 			{
-				graph->CreateWire(bridgeCache[i][j], bridgeCache.back().back(), elbow);
+				connections.emplace_back(bridgeCache[i][j], bridgeCache.back().back());
 			}
 		}
 		break;
@@ -157,12 +172,14 @@ void Tab::BridgeSelection(ElbowConfig elbow)
 			_ASSERT_EXPR(bridgeCache[i - 1].size() == bridgeCache[i].size(), L"Cache size mismatch!");
 			for (size_t j = 0; j < bridgeCache[i].size(); ++j)
 			{
-				graph->CreateWire(bridgeCache[i - 1][j], bridgeCache[i][j], elbow);
+				connections.emplace_back(bridgeCache[i - 1][j], bridgeCache[i][j]);
 			}
 		}
 		break;
 	}
 
+	graph->CreateWires(connections, elbow);
+
 	ClearSelection();
 }
 
@@ -223,6 +240,23 @@ void Tab::Set2DMode(bool value)
 	}
 }
 
+void Tab::SetDrawOffset(IVec2 offset)
+{
+	Camera2D shifted = camera;
+	shifted.target.x -= (float)offset.x;
+	shifted.target.y -= (float)offset.y;
+	BeginMode2D(shifted); // Replaces the current transform rather than stacking on it
+}
+
+IRect Tab::GetViewBounds() const
+{
+	Vector2 start = GetScreenToWorld2D({ 0,0 }, camera);
+	Vector2 end = GetScreenToWorld2D(owningWindow->WindowExtents(), camera);
+	IVec2 min((int)std::floor(start.x), (int)std::floor(start.y));
+	IVec2 max((int)std::ceil(end.x), (int)std::ceil(end.y));
+	return IRect(min.x, min.y, max.x - min.x + 1, max.y - min.y + 1);
+}
+
 void Tab::UpdateCamera()
 {
 	camera.offset = owningWindow->WindowExtents() / 2;
@@ -22,8 +22,9 @@ struct Tab
 
 	Camera2D camera;
 	Graph* graph;
-	std::vector<Node*> selection;
 private:
+	std::vector<Node*> selection;
+	std::vector<bool> selectionMembership; // Indexed by NodeHandle; mirrors selection
 	// Note: Make sure not to modify this without updating the bridge cache!
 	std::vector<IRect> selectionRecs;
 public:
@@ -38,6 +39,18 @@ public:
 	{
 		return selection.size();
 	}
+	inline const std::vector<Node*>& Selection() const
+	{
+		return selection;
+	}
+	bool IsSelected(const Node* node) const;
+	// Nodes already in the selection are skipped
+	void Select(Node* node);
+	void Select(const std::vector<Node*>& nodes);
+	// Keeps the selection rectangles
+	void DeselectNodes();
+	// Replaces the selected nodes with those inside the selection rectangles
+	void SelectNodesInRecs();
 
 	inline bool SelectionRectExists() const
 	{
@@ -81,7 +94,7 @@ public:
 	}
 	inline void ClearSelection()
 	{
-		selection.clear();
+		DeselectNodes();
 		selectionRecs.clear();
 		bridgeCache.clear();
 		cachedBridgeType = WireBridgeType::none;
@@ -96,6 +109,10 @@ public:
 	void DrawBridgePreview(ElbowConfig elbow, Color color) const;
 
 	void UpdateCamera();
+	// World-space rectangle the camera shows
+	IRect GetViewBounds() const;
 
 	void Set2DMode(bool value);
+	// Shifts everything drawn in 2D mode by offset (in world space) until set back to zero
+	void SetDrawOffset(IVec2 offset);
 };
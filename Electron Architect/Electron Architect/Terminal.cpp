@@ -0,0 +1,22 @@
+#include <cstdio>
+#include "Terminal.h"
+// Kept apart from everything else; the Windows headers clash with raylib
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+bool AttachParentConsole()
+{
+#ifdef _WIN32
+    if (!AttachConsole(ATTACH_PARENT_PROCESS))
+        return false;
+    FILE* stream;
+    freopen_s(&stream, "CONOUT$", "w", stdout);
+    freopen_s(&stream, "CONOUT$", "w", stderr);
+    return true;
+#else
+    return true; // Already writing to the terminal
+#endif
+}
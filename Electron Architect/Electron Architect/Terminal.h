@@ -0,0 +1,5 @@
+#pragma once
+
+// The app is built as a Windows program, which starts without stdout or stderr even when run from a command prompt.
+// Hooks both up to the console of whatever launched it, if there is one; returns whether there was.
+bool AttachParentConsole();
@@ -99,6 +99,9 @@ void PenTool::Update(Window& window, bool allowHover)
     // Click (start drag)
     if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) [[unlikely]]
     {
+        // Placing, bisecting and wiring in one click is one undo step
+        Graph::EditGroup group(*window.CurrentTab().graph);
+
         dragging = true;
         Node* newNode = window.hoveredNode;
 
@@ -302,8 +305,6 @@ void EditTool::Update(Window& window, bool allowHover)
         return;
     }
 
-    // Todo: fix bug with canceling multiple-drag (And update group dragging to match!!)
-
     if (!allowHover)
     {
         window.hoveredWire = nullptr;
@@ -337,7 +338,10 @@ void EditTool::Update(Window& window, bool allowHover)
         }
         else if (nodeBeingDragged && !window.SelectionExists())
         {
-            hoveringMergable = window.CurrentTab().graph->FindNodeAtPos(window.cursorPos); // This will come before updating the position of the dragged node
+            hoveringMergable = window.CurrentTab().graph->FindNodeAtPos(window.cursorPos);
+            // The dragged node is still indexed where it was picked up
+            if (hoveringMergable == nodeBeingDragged)
+                hoveringMergable = nullptr;
         }
     }
 
@@ -350,7 +354,7 @@ void EditTool::Update(Window& window, bool allowHover)
             draggingGroupCorner = true;
         }
         // There is a selection, and a node inside it has been pressed (move selected)
-        else if (!!window.hoveredNode && std::find(window.CurrentTab().selection.begin(), window.CurrentTab().selection.end(), window.hoveredNode) != window.CurrentTab().selection.end())
+        else if (!!window.hoveredNode && window.CurrentTab().IsSelected(window.hoveredNode))
         {
             nodeBeingDragged = window.hoveredNode;
             wireBeingDragged = nullptr;
@@ -360,19 +364,15 @@ void EditTool::Update(Window& window, bool allowHover)
         {
             // Add to selection when holding ctrl
             if (!(IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL)))
-                window.CurrentTab().selection.clear();
-            window.CurrentTab().selection.push_back(window.hoveredNode);
+                window.CurrentTab().DeselectNodes();
+            window.CurrentTab().Select(window.hoveredNode);
             nodeBeingDragged = window.hoveredNode;
             wireBeingDragged = nullptr;
         }
         // Modify the last selection rectangle
         else if (window.IsSelectionRectValid() && (IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT)))
         {
-            window.CurrentTab().selection.clear();
-            for (const IRect& rec : window.CurrentTab().SelectionRecs())
-            {
-                window.CurrentTab().graph->FindNodesInRect(window.CurrentTab().selection, rec);
-            }
+            window.CurrentTab().SelectNodesInRecs();
             selectionWIP = true;
         }
         // Create a new selection rectangle
@@ -393,7 +393,9 @@ void EditTool::Update(Window& window, bool allowHover)
             // selectionStart being used as an offset here
             if (draggingGroup = !!window.hoveredGroup)
             {
-                window.CurrentTab().graph->FindNodesInGroup(window.CurrentTab().selection, window.hoveredGroup);
+                std::vector<Node*> groupNodes;
+                window.CurrentTab().graph->FindNodesInGroup(groupNodes, window.hoveredGroup);
+                window.CurrentTab().Select(groupNodes);
                 selectionStart = (window.cursorPos - (fallbackPos = window.hoveredGroup->GetPosition()));
             }
 
@@ -416,16 +418,17 @@ void EditTool::Update(Window& window, bool allowHover)
         window.CurrentTab().GetLastSelectionRec()->wh = max - (window.CurrentTab().GetLastSelectionRec()->xy = min);
     }
     // Node
+    // Dragged nodes are only drawn moved; they are committed on release
     else if (!!nodeBeingDragged)
     {
+        Graph* graph = window.CurrentTab().graph;
         // Multiple selection
         if (window.CurrentTab().SelectionExists())
         {
+            if (!graph->IsDragging())
+                graph->BeginDrag(window.CurrentTab().Selection());
             const IVec2 offset = window.GetCursorDelta();
-            for (Node* node : window.CurrentTab().selection)
-            {
-                node->SetPosition_Temporary(node->GetPosition() + offset);
-            }
+            graph->SetDragOffset(graph->GetDragOffset() + offset);
             // Explicit exception to the rule of selectionRecs being modified without updating bridge cache
             // Please forgive my transgressions
             for (IRect& rec : const_cast<std::vector<IRect>&>(window.CurrentTab().SelectionRecs()))
@@ -434,22 +437,25 @@ void EditTool::Update(Window& window, bool allowHover)
             }
         }
         else
-            nodeBeingDragged->SetPosition_Temporary(window.cursorPos);
+        {
+            if (!graph->IsDragging())
+                graph->BeginDrag({ nodeBeingDragged });
+            graph->SetDragOffset(window.cursorPos - nodeBeingDragged->GetPosition());
+        }
     }
     // Wire
     else if (!!wireBeingDragged)
     {
-        wireBeingDragged->SnapElbowToLegal(window.cursorPos);
+        window.CurrentTab().graph->SnapWireElbowToLegal(wireBeingDragged, window.cursorPos);
     }
     // Group
     else if (draggingGroup)
     {
-        window.hoveredGroup->SetPosition(window.cursorPos - selectionStart);
-        for (Node* node : window.CurrentTab().selection)
-        {
-            const IVec2 offset = window.GetCursorDelta();
-            node->SetPosition_Temporary(node->GetPosition() + offset);
-        }
+        Graph* graph = window.CurrentTab().graph;
+        graph->MoveGroup(window.hoveredGroup, window.cursorPos - selectionStart);
+        if (!graph->IsDragging() && window.CurrentTab().SelectionExists())
+            graph->BeginDrag(window.CurrentTab().Selection());
+        graph->SetDragOffset(window.cursorPos - fallbackPos);
     }
     // Resize group
     else if (draggingGroupCorner)
@@ -483,7 +489,7 @@ void EditTool::Update(Window& window, bool allowHover)
             break;
         }
         captureBounds = IRectFromTwoPoints(cursorEnd, otherEnd);
-        groupCorner.group->SetCaptureBounds(captureBounds);
+        window.CurrentTab().graph->ResizeGroup(groupCorner.group, captureBounds);
     }
 
     // Release
@@ -494,20 +500,22 @@ void EditTool::Update(Window& window, bool allowHover)
         {
             if (!!nodeBeingDragged)
             {
-                nodeBeingDragged->SetPosition(fallbackPos);
+                // Nothing was moved yet, only the selection rectangles
+                for (IRect& rec : const_cast<std::vector<IRect>&>(window.CurrentTab().SelectionRecs()))
+                {
+                    rec.xy -= window.CurrentTab().graph->GetDragOffset();
+                }
+                window.CurrentTab().graph->EndDrag(false);
             }
             else if (draggingGroup)
             {
-                window.hoveredGroup->SetPosition(fallbackPos);
-                for (Node* node : window.CurrentTab().selection)
-                {
-                    IVec2 offset = (fallbackPos + selectionStart) - window.cursorPos;
-                    node->SetPosition_Temporary(node->GetPosition() + offset);
-                }
+                // fallbackPos is where the cursor was pressed, selectionStart the cursor's offset into the group
+                window.CurrentTab().graph->MoveGroup(window.hoveredGroup, fallbackPos - selectionStart);
+                window.CurrentTab().graph->EndDrag(false);
             }
             else if (draggingGroupCorner)
             {
-                // Todo
+                window.CurrentTab().graph->CancelGroupReshape();
             }
             else if (selectionWIP)
             {
@@ -522,6 +530,7 @@ void EditTool::Update(Window& window, bool allowHover)
                 _ASSERT_EXPR(hoveringMergable != nodeBeingDragged, L"Node being dragged is trying to merge with itself");
                 if (!!hoveringMergable)
                 {
+                    window.CurrentTab().graph->EndDrag(false);
                     if (IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT))
                     {
                         window.hoveredNode = window.CurrentTab().graph->MergeNodes(hoveringMergable, nodeBeingDragged);
@@ -534,34 +543,24 @@ void EditTool::Update(Window& window, bool allowHover)
                     }
                 }
                 else
-                    nodeBeingDragged->SetPosition(window.cursorPos);
+                    window.CurrentTab().graph->EndDrag(true);
             }
             else if (draggingGroup)
             {
-                for (Node* node : window.CurrentTab().selection)
-                {
-                    node->SetPosition(node->GetPosition());
-                }
+                window.CurrentTab().graph->EndDrag(true);
             }
             else if (draggingGroupCorner)
             {
-                // Todo
+                window.CurrentTab().graph->EndGroupReshape();
             }
             else if (selectionWIP)
             {
                 selectionWIP = false;
                 window.CurrentTab().ConfirmLastSelectionRec();
-                window.CurrentTab().selection.clear();
                 if (window.IsSelectionRectValid())
-                {
-                    for (const IRect& rec : window.CurrentTab().SelectionRecs())
-                    {
-                        window.CurrentTab().graph->FindNodesInRect(window.CurrentTab().selection, rec);
-                    }
-                }
-                std::unordered_set<Node*> selectionUnique(window.CurrentTab().selection.begin(), window.CurrentTab().selection.end());
-                window.CurrentTab().selection.clear();
-                window.CurrentTab().selection = std::vector<Node*>(selectionUnique.begin(), selectionUnique.end());
+                    window.CurrentTab().SelectNodesInRecs();
+                else
+                    window.CurrentTab().DeselectNodes();
 
                 window.CurrentTab().UpdateBridgeCache();
             }
@@ -579,13 +578,7 @@ void EditTool::Update(Window& window, bool allowHover)
     {
         if (!!window.hoveredNode)
         {
-            window.hoveredNode->SetGate(window.gatePick);
-            switch (window.hoveredNode->GetGate())
-            {
-            case Gate::RESISTOR:  window.hoveredNode->SetResistance(window.storedExtraParam); break;
-            case Gate::LED:       window.hoveredNode->SetColorIndex(window.storedExtraParam); break;
-            case Gate::CAPACITOR: window.hoveredNode->SetCapacity(window.storedExtraParam);   break;
-            }
+            window.CurrentTab().graph->SetNodeGate(window.hoveredNode, window.gatePick, window.storedExtraParam);
         }
         else if (!!window.hoveredGroup)
         {
@@ -693,7 +686,15 @@ void EditTool::Draw(Window& window)
             }
 
             if (actuallyBridgeable)
+            {
+                // Every bridged node is selected, so they all move together
+                bool dragging = window.CurrentTab().graph->IsDragging();
+                if (dragging)
+                    window.CurrentTab().SetDrawOffset(window.CurrentTab().graph->GetDragOffset());
                 window.CurrentTab().DrawBridgePreview(window.currentWireElbowConfig, UIColor(UIColorID::UI_COLOR_AVAILABLE));
+                if (dragging)
+                    window.CurrentTab().SetDrawOffset(IVec2::Zero());
+            }
         }
         else [[likely]]
         {
@@ -734,9 +735,11 @@ void EditTool::Draw(Window& window)
 
     window.CurrentTab().graph->DrawNodes(window.CurrentTab().camera.zoom, UIColor(UIColorID::UI_COLOR_ACTIVE), UIColor(UIColorID::UI_COLOR_FOREGROUND));
 
+    const Graph* graph = window.CurrentTab().graph;
+
     if (!!window.hoveredNode)
     {
-        window.hoveredNode->DrawStateless(window.CurrentTab().camera.zoom, UIColor(UIColorID::UI_COLOR_CAUTION), UIColor(UIColorID::UI_COLOR_BACKGROUND));
+        Node::Draw(window.CurrentTab().camera.zoom, graph->GetDrawPosition(window.hoveredNode), window.hoveredNode->GetGate(), UIColor(UIColorID::UI_COLOR_CAUTION), UIColor(UIColorID::UI_COLOR_BACKGROUND));
     }
     if (!!window.hoveredWire)
     {
@@ -746,7 +749,7 @@ void EditTool::Draw(Window& window)
 
     if (!!nodeBeingDragged && hoveringMergable)
     {
-        DrawCircleIV(nodeBeingDragged->GetPosition(), Node::g_nodeRadius * 2.0f, UIColor(UIColorID::UI_COLOR_SPECIAL));
+        DrawCircleIV(graph->GetDrawPosition(nodeBeingDragged), Node::g_nodeRadius * 2.0f, UIColor(UIColorID::UI_COLOR_SPECIAL));
         window.DrawTooltipAtCursor(
             "Hold [shift] to merge on release.\n"
             "Otherwise, nodes will only be swapped.", UIColor(UIColorID::UI_COLOR_SPECIAL));
@@ -754,9 +757,9 @@ void EditTool::Draw(Window& window)
 
 
     // Selection
-    for (Node* node : window.CurrentTab().selection)
+    for (Node* node : window.CurrentTab().Selection())
     {
-        node->DrawHighlight(window.CurrentTab().camera.zoom, UIColor(UIColorID::UI_COLOR_AVAILABLE));
+        Node::DrawHighlight(window.CurrentTab().camera.zoom, graph->GetDrawPosition(node), node->GetGate(), UIColor(UIColorID::UI_COLOR_AVAILABLE));
         //DrawCircleIV(node->GetPosition(), node->g_nodeRadius + 3, UIColor(UIColorID::UI_COLOR_AVAILABLE));
     }
     for (Node* node : selectionPreviewNodes)
@@ -769,11 +772,11 @@ void EditTool::DrawProperties(Window& window)
 {
     // Selection stats
     if (window.SelectionExists() && window.CurrentTab().SelectionSize() > 1)
-        window.PushPropertySection_Selection("Selection", window.CurrentTab().selection);
+        window.PushPropertySection_Selection("Selection", window.CurrentTab().Selection());
     else if (window.CurrentTab().SelectionSize() == 1)
     {
-        _ASSERT_EXPR(!!window.CurrentTab().selection[0], L"Cannot show properties for null");
-        window.PushPropertySection_Node("Selected node", window.CurrentTab().selection[0]);
+        _ASSERT_EXPR(!!window.CurrentTab().Selection()[0], L"Cannot show properties for null");
+        window.PushPropertySection_Node("Selected node", window.CurrentTab().Selection()[0]);
     }
     // Node hover stats
     window.PushPropertySection_Node("Hovered node", window.hoveredNode);
@@ -989,7 +992,7 @@ void InteractTool::Update(Window& window, bool allowHover)
         window.hoveredNode = window.CurrentTab().graph->FindNodeAtPos(window.cursorPos);
 
     if (!!window.hoveredNode && window.hoveredNode->IsInteractive() && IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
-        window.hoveredNode->SetGate(window.hoveredNode->GetGate() == Gate::NOR ? Gate::OR : Gate::NOR);
+        window.CurrentTab().graph->SetNodeGate(window.hoveredNode, window.hoveredNode->GetGate() == Gate::NOR ? Gate::OR : Gate::NOR, window.hoveredNode->GetExtraParam());
 
     
 }
@@ -1064,7 +1067,7 @@ void BlueprintMenu::Update(Window& window, bool allowHover)
         int maxY = 0; // I know there must be a better algorithm, but this will at least be progress.
         hovering = nullptr;
         hoveredRec = IRect(0);
-        for (Blueprint* bp : window.CurrentTab().graph->GetBlueprints())
+        for (const std::shared_ptr<Blueprint>& bp : window.library.GetBlueprints())
         {
             IRect rec = bp->GetSelectionPreviewRect(pos);
             if (rec.Right() > window.windowWidth)
@@ -1075,7 +1078,8 @@ void BlueprintMenu::Update(Window& window, bool allowHover)
 
             if (window.CursorInUIBounds(rec))
             {
-                hovering = bp;
+                hovering = bp.get();
+                hovering->LoadBody(); // Library bodies are parsed on first hover
                 hoveredRec = rec;
                 break;
             }
@@ -1109,7 +1113,7 @@ void BlueprintMenu::Draw(Window& window)
     DrawRectangle(0, 0, window.windowWidth, Button::g_width, UIColor(UIColorID::UI_COLOR_BACKGROUND1));
     const int padding = Button::g_width / 2 - (window.FontSize() / 2);
     DrawText("Blueprints", padding, padding, window.FontSize(), UIColor(UIColorID::UI_COLOR_FOREGROUND));
-    for (Blueprint* bp : window.CurrentTab().graph->GetBlueprints())
+    for (const std::shared_ptr<Blueprint>& bp : window.library.GetBlueprints())
     {
         IRect rec = bp->GetSelectionPreviewRect(pos);
         if (rec.Right() > window.windowWidth)
@@ -1121,7 +1125,7 @@ void BlueprintMenu::Draw(Window& window)
         Color background;
         Color foreground;
         Color foregroundIO;
-        if (!!hovering && bp == hovering) [[unlikely]]
+        if (!!hovering && bp.get() == hovering) [[unlikely]]
         {
             background = UIColor(UIColorID::UI_COLOR_AVAILABLE);
             foreground = UIColor(UIColorID::UI_COLOR_FOREGROUND2);
@@ -37,7 +37,6 @@ void DrawTextShadowedIV(const std::string& text, IVec2 pos, int fontSize, Color
 Window::Window() :
     windowWidth(1280),
     windowHeight(720),
-    consoleOutput{ "", "", "", "", "", "", },
     modeButtons{
         IconButton(
             IVec2(),
@@ -61,6 +60,8 @@ Window::Window() :
             "Drag nodes with [left click].\n"
             "Hold [ctrl] to make multiple selections.\n"
             "Press [ctrl]+[g] to make a group.\n"
+            "Press [ctrl]+[e] to export the hovered group,\n"
+            "  else the last selection, as SVG.\n"
             "[right click] a group to rename it.\n"
             "Drag wire joints with [left click].\n"
             "  Wire joints snap to 45 degree angles.\n"
@@ -353,7 +354,6 @@ ColorButton(
     ClearLog();
     InitWindow(windowWidth, windowHeight, "Electron Architect");
     SetExitKey(0);
-    SetTargetFPS(GetMonitorRefreshRate(GetCurrentMonitor()));
 
     iconSheet16x = LoadTextureFromImage(MEMORY_IMAGE(ICONS16X));
     iconSheet32x = LoadTextureFromImage(MEMORY_IMAGE(ICONS32X));
@@ -367,13 +367,14 @@ ColorButton(
     SetMode(Mode::PEN);
     SetGate(Gate::OR);
     ReloadConfig();
+    ApplyFrameCap();
 }
 
 Window::~Window()
 {
     for (const Tab* tab : tabs)
     {
-        tab->graph->Save("session.cg");
+        tab->graph->Save("session.cgb");
         tab->graph->Export("render.svg");
         delete tab;
     }
@@ -490,12 +491,16 @@ ModeType Window::GetModeType()
 
 void Window::SetMode(Mode newMode)
 {
-    Log(LogType::attempt, "Changing mode from { base: " +
-        (base ? ModeName(base->GetMode()) : "null") + "; overlay: " +
-        (overlay ? ModeName(overlay->GetMode()) : "null") + " } to " + ModeName(newMode));
+    Log(LogType::attempt, "Changing mode from { base: {}; overlay: {} } to {}",
+        base ? ModeName(base->GetMode()) : "null",
+        overlay ? ModeName(overlay->GetMode()) : "null",
+        ModeName(newMode));
 
     if (!!base && base->GetMode() == Mode::EDIT && TypeOfMode(newMode) == ModeType::Basic && newMode != Mode::EDIT)
+    {
+        CurrentTab().graph->EndDrag(false); // The tool holding the drag is going away
         ClearSelection();
+    }
 
     b_cursorMoved = true;
 
@@ -565,9 +570,9 @@ void Window::SetMode(Mode newMode)
         Log(LogType::error, "Base mode is null");
         exit(1);
     }
-    Log(LogType::success, "Mode changed to { " +
-        (base ? ModeName(base->GetMode()) : "null") + ";" +
-        (overlay ? ModeName(overlay->GetMode()) : "null") + " }");
+    Log(LogType::success, "Mode changed to { {};{} }",
+        base ? ModeName(base->GetMode()) : "null",
+        overlay ? ModeName(overlay->GetMode()) : "null");
 }
 
 void Window::SetGate(Gate newGate)
@@ -579,7 +584,7 @@ void Window::SetGate(Gate newGate)
         "Capacity: %i ticks",
         "Color: %s"
     };
-    Log(LogType::info, "Changed gate from " + GateName(gatePick) + " to " + GateName(newGate));
+    Log(LogType::info, "Changed gate from {} to {}", GateName(gatePick), GateName(newGate));
     gatePick = newGate;
     switch (newGate)
     {
@@ -612,10 +617,53 @@ void Window::ClearOverlayMode()
 
 void Window::IncrementTick()
 {
+    // Slow frames catch up on a few ticks, but not so many that the next frame is slower still
+    constexpr int maxTicksPerFrame = 4;
+    const double interval = 1.0 / ticksPerSecond;
+    double now = GetTime();
+    ticksThisFrame = 0;
+    while (nextTickTime <= now && ticksThisFrame < maxTicksPerFrame)
+    {
+        ++ticksThisFrame;
+        nextTickTime += interval;
+    }
+    // Also where a wait for input left it
+    if (nextTickTime <= now)
+        nextTickTime = now + interval;
+}
+
+void Window::ApplyFrameCap()
+{
+    SetTargetFPS(maxFPS > 0 ? maxFPS : GetMonitorRefreshRate(GetCurrentMonitor()));
+}
+
+void Window::UpdateFramePacing(bool busy)
+{
+    // How long to keep drawing after the last input, for anything it set off
+    constexpr double idleDelay = 0.5;
+
+    double now = GetTime();
+    // Any frame after a wait was woken by input
+    bool input = waitingForEvents || IsWindowResized() ||
+        GetMouseDelta().x != 0.0f || GetMouseDelta().y != 0.0f || GetMouseWheelMove() != 0.0f ||
+        IsMouseButtonDown(MOUSE_BUTTON_LEFT) || IsMouseButtonDown(MOUSE_BUTTON_RIGHT) || IsMouseButtonDown(MOUSE_BUTTON_MIDDLE);
+    // Nothing else reads the key queue
+    while (GetKeyPressed())
+    {
+        input = true;
+    }
+    if (input || busy || !simulationSettled)
+        lastActivityTime = now;
 
-    ++tickFrame;
-    tickFrame %= framesPerTick;
-    tickThisFrame = tickFrame == 0;
+    bool idle = now - lastActivityTime > idleDelay;
+    if (idle == waitingForEvents)
+        return;
+    waitingForEvents = idle;
+    // EndDrawing blocks until the next input while this is on
+    if (idle)
+        EnableEventWaiting();
+    else
+        DisableEventWaiting();
 }
 
 void Window::UpdateCursorPos()
@@ -645,8 +693,8 @@ void Window::UpdateSize()
 {
     windowWidth = GetRenderWidth();
     windowHeight = GetRenderHeight();
-    Log(LogType::info, "Window width is now " + std::to_string(windowWidth));
-    Log(LogType::info, "Window height is now " + std::to_string(windowHeight));
+    Log(LogType::info, "Window width is now {}", windowWidth);
+    Log(LogType::info, "Window height is now {}", windowHeight);
     ReloadPanes();
 }
 
@@ -654,9 +702,9 @@ void Window::CopySelectionToClipboard()
 {
     // Todo: actually copy a csv to the user's clipboard
     Log(LogType::info, "Copied selection to clipboard");
-    if (!CurrentTab().selection.empty()) // Copy selection
+    if (CurrentTab().SelectionExists()) // Copy selection
     {
-        g_clipboardBP = Blueprint(CurrentTab().selection);
+        g_clipboardBP = Blueprint(CurrentTab().Selection());
         clipboard = &g_clipboardBP;
     }
     else // Clear selection
@@ -681,12 +729,30 @@ bool Window::IsSelectionRectValid() const
     return !!edit && !edit->selectionWIP && CurrentTab().SelectionRectExists();
 }
 
+void Window::ExportSVG()
+{
+    Graph* graph = CurrentTab().graph;
+    if (!!hoveredGroup)
+        graph->ExportGroup("export.svg", hoveredGroup);
+    else if (const IRect* rec = CurrentTab().GetLastSelectionRecConst())
+        graph->Export("export.svg", *rec);
+    else
+        graph->Export("export.svg");
+}
+
 void Window::SaveBlueprint()
 {
     if (!IsClipboardValid())
         return;
-    CurrentTab().graph->StoreBlueprint(clipboard);
-    CurrentTab().graph->GetBlueprints().back()->Save();
+    // Re-saving a circuit that's already in the library would only duplicate its body
+    if (const Blueprint* existing = library.FindIdentical(*clipboard))
+    {
+        Log(LogType::info, LogCategory::blueprints, "Blueprint is identical to {}; not stored again", existing->name);
+        return;
+    }
+    Blueprint* stored = library.Store(*clipboard);
+    stored->Save(compressFiles);
+    Log(LogType::success, LogCategory::blueprints, "Stored blueprint {}", stored->name);
 }
 
 bool Window::IsClipboardValid() const
@@ -711,8 +777,35 @@ void Window::ClearSelection()
 
 void Window::DestroySelection()
 {
-    CurrentTab().graph->DestroyNodes(CurrentTab().selection);
+    CurrentTab().graph->DestroyNodes(CurrentTab().Selection());
+    ClearSelection();
+}
+
+void Window::Undo()
+{
+    if (CurrentTab().graph->Undo())
+        ForgetGraphReferences();
+}
+void Window::Redo()
+{
+    if (CurrentTab().graph->Redo())
+        ForgetGraphReferences();
+}
+void Window::ForgetGraphReferences()
+{
+    hoveredNode = nullptr;
+    hoveredWire = nullptr;
+    hoveredGroup = nullptr;
     ClearSelection();
+
+    // Rebuild the base tool so it lets go of any nodes/wires it was holding; menus and overlays don't hold any
+    Tool* keptOverlay = overlay;
+    overlay = nullptr;
+    Mode mode = base->GetMode();
+    delete base;
+    base = nullptr;
+    SetMode(mode);
+    overlay = keptOverlay;
 }
 
 void Window::CheckHotkeys()
@@ -736,6 +829,10 @@ void Window::CheckHotkeys()
         // Ctrl-Shift
         else if (IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT))
         {
+            // Redo
+            if (IsKeyPressed(KEY_Z))
+                Redo();
+
             return; // Don't miscommunicate to the user!!
         }
 
@@ -766,6 +863,18 @@ void Window::CheckHotkeys()
         if (IsKeyPressed(KEY_G) && IsSelectionRectValid())
             MakeGroupFromSelection();
 
+        // Export
+        if (IsKeyPressed(KEY_E))
+            ExportSVG();
+
+        // Undo
+        if (IsKeyPressed(KEY_Z))
+            Undo();
+
+        // Redo
+        if (IsKeyPressed(KEY_Y))
+            Redo();
+
         // Save
         if (IsKeyPressed(KEY_S) && GetMode() == Mode::PASTE)
         {
@@ -1001,7 +1110,7 @@ IRect Window::GetSelectionBounds(const std::vector<Node*>& vec) const
 IRect Window::GetSelectionBounds() const
 {
     if (!tabs.empty())
-        return GetSelectionBounds(CurrentTab().selection);
+        return GetSelectionBounds(CurrentTab().Selection());
     else
         return IRect(0);
 }
@@ -1149,14 +1258,17 @@ void Window::SaveConfig() const
         "\nblueprint_menu_lod=" << (int)blueprintLOD <<
         "\nclipboard_preview_lod=" << (int)clipboardPreviewLOD <<
         "\npaste_preview_lod=" << (int)pastePreviewLOD <<
-        "\nframes_per_tick=" << (int)framesPerTick <<
+        "\nmax_fps=" << maxFPS <<
+        "\nticks_per_second=" << ticksPerSecond <<
+        "\ncompress_files=" << compressFiles <<
         "\n\n[Preferences]"
         "\nwindow_position_size=" << GetWindowPosition().x << '|' << GetWindowPosition().y << '|' << GetRenderWidth() << '|' << GetRenderHeight() <<
         "\nui_scale=" << uiScale <<
         "\ntoolpane_expanded=" << toolPaneSizeState <<
         "\nshow_console=" << consoleOn <<
         "\nshow_properties=" << propertiesOn <<
-        "\nmin_log_level=" << (int)minLogLevel <<
+        "\nmin_log_level=" << (int)logger.GetMinLevel() <<
+        "\nlog_categories=" << Logger::CategoriesToString(logger.GetCategories()) <<
         "\nselection_preview=" << selectionPreview;
         
     config.close();
@@ -1198,12 +1310,15 @@ void Window::ReloadConfig()
         blueprintLOD = 0;
         clipboardPreviewLOD = 0;
         pastePreviewLOD = 0;
-        framesPerTick = 6;
+        maxFPS = 0;
+        ticksPerSecond = 10;
+        compressFiles = false;
         uiScale = 1;
         toolPaneSizeState = 1;
         consoleOn = 1;
         propertiesOn = 1;
-        minLogLevel = LogType::warning;
+        logger.SetMinLevel(LogType::warning);
+        logger.SetCategories(g_allLogCategories);
         selectionPreview = false;
     }
 
@@ -1249,7 +1364,10 @@ void Window::ReloadConfig()
         else if (attribute == "blueprint_menu_lod")     blueprintLOD        = std::stoi(value);
         else if (attribute == "clipboard_preview_lod")  clipboardPreviewLOD = std::stoi(value);
         else if (attribute == "paste_preview_lod")      pastePreviewLOD     = std::stoi(value);
-        else if (attribute == "frames_per_tick")        framesPerTick       = std::stoi(value);
+        else if (attribute == "max_fps")                maxFPS              = std::stoi(value);
+        else if (attribute == "ticks_per_second")       ticksPerSecond      = std::stoi(value);
+        else if (attribute == "frames_per_tick")        ticksPerSecond      = 60 / std::max(1, std::stoi(value)); // Older configs
+        else if (attribute == "compress_files")         compressFiles       = !!std::stoi(value);
         else if (attribute == "window_position_size")
         {
             IRect windowRec = ConfigStrToIRect(value);
@@ -1260,7 +1378,8 @@ void Window::ReloadConfig()
         else if (attribute == "toolpane_expanded")      toolPaneSizeState   = std::stoi(value);
         else if (attribute == "show_console")           consoleOn           = std::stoi(value);
         else if (attribute == "show_properties")        propertiesOn        = std::stoi(value);
-        else if (attribute == "min_log_level")          minLogLevel = LogType(std::min(std::max(0, std::stoi(value)), 4));
+        else if (attribute == "min_log_level")          logger.SetMinLevel(LogType(std::min(std::max(0, std::stoi(value)), 4)));
+        else if (attribute == "log_categories")         logger.SetCategories(Logger::ParseCategories(value));
         else if (attribute == "selection_preview")      selectionPreview    = !!std::stoi(value);
     }
 
@@ -1268,6 +1387,8 @@ void Window::ReloadConfig()
         uiScale = 2;
     if (uiScale <= 1)
         uiScale = 1;
+    if (ticksPerSecond < 1)
+        ticksPerSecond = 1;
 
     IconButton::g_width = 16 * uiScale;
 
@@ -1669,65 +1790,52 @@ void Window::CleanConsolePane()
 }
 void Window::DrawConsoleOutput()
 {
-    for (int i = 0; i < _countof(consoleOutput); ++i)
+    for (size_t i = 0; i < _countof(consoleOutput); ++i)
     {
-        if (consoleOutput[i].size() < 2) // ""
+        ConsoleLogLine& line = consoleOutput[(consoleNext + i) % _countof(consoleOutput)];
+        if (!line.event.format) // Nothing logged here yet
             continue;
+        if (line.text.empty())
+            line.event.Format(line.text, line.previousTime);
 
         Color color;
-        switch (consoleOutput[i][1])
+        switch (line.event.type)
         {
-        case 'I': color = UIColor(UIColorID::UI_COLOR_FOREGROUND);  break;
-        case 'A': color = UIColor(UIColorID::UI_COLOR_SPECIAL);     break;
-        case 'S': color = UIColor(UIColorID::UI_COLOR_FOREGROUND1); break;
-        case 'W': color = UIColor(UIColorID::UI_COLOR_CAUTION);     break;
-        case 'E': color = UIColor(UIColorID::UI_COLOR_DESTRUCTIVE); break;
-        default:  color = UIColor(UIColorID::UI_COLOR_ERROR);       break; // Malformed
+        case LogType::info:     color = UIColor(UIColorID::UI_COLOR_FOREGROUND);  break;
+        case LogType::attempt:  color = UIColor(UIColorID::UI_COLOR_SPECIAL);     break;
+        case LogType::success:  color = UIColor(UIColorID::UI_COLOR_FOREGROUND1); break;
+        case LogType::warning:  color = UIColor(UIColorID::UI_COLOR_CAUTION);     break;
+        case LogType::error:    color = UIColor(UIColorID::UI_COLOR_DESTRUCTIVE); break;
+        default:                color = UIColor(UIColorID::UI_COLOR_ERROR);       break; // Malformed
         }
         DrawTextIV(
-            consoleOutput[i].c_str(),
-            consolePaneRec.xy + Height(FontSize() * 2 * (i + 1)) + FontPadding(),
+            line.text.c_str(),
+            consolePaneRec.xy + Height(FontSize() * 2 * (int)(i + 1)) + FontPadding(),
             FontSize(), color);
     }
 }
-std::string LogTypeStr(LogType type)
-{
-    switch (type)
-    {
-    case LogType::info:     return "[INFO] ";
-    case LogType::attempt:  return "[ATTEMPT] ";
-    case LogType::success:  return "[SUCCESS] ";
-    case LogType::warning:  return "[WARNING] ";
-    case LogType::error:    return "[ERROR] ";
-    default:                return "[UNKNOWN] ";
-    }
-}
-void Window::Log(LogType type, const std::string& output)
+void Window::Log(LogEvent&& event)
 {
-    if ((int)type < (int)minLogLevel)
-        return;
+    ConsoleLogLine& line = consoleOutput[consoleNext];
+    consoleNext = (consoleNext + 1) % _countof(consoleOutput);
+    line.event = event;
+    line.previousTime = timeOfLastLog;
+    line.text.clear();
+    timeOfLastLog = event.time;
 
-    double logTime = GetTime();
-    consoleOutput[0] =
-        LogTypeStr(type) + output +
-        " - t+" + std::to_string(logTime) +
-        "(" + std::to_string((logTime - timeOfLastLog) * 1000) + "ms)";
-
-    std::ofstream logfile("session.log", std::ios_base::app);
-    logfile << consoleOutput[0] << '\n';
-    logfile.close();
-
-    for (int i = 1; i < _countof(consoleOutput); ++i)
-    {
-        consoleOutput[i - 1].swap(consoleOutput[i]); // [0] gets sequentially traded forward without copying
-    }
-    timeOfLastLog = logTime;
+    bool error = event.type == LogType::error;
+    logger.Push(std::move(event));
+    if (error)
+        logger.Flush();
 }
 void Window::ClearLog()
 {
-    timeOfLastLog = GetTime();
-    std::ofstream logfile("session.log", std::ios_base::trunc);
-    logfile.close();
+    for (ConsoleLogLine& line : consoleOutput)
+    {
+        line = ConsoleLogLine();
+    }
+    timeOfLastLog = logger.Now();
+    logger.Clear();
     Log(LogType::info, "Start of log");
 }
 void Window::CleanPropertiesPane()
@@ -4,6 +4,8 @@
 #include "IVec.h"
 #include "UIColors.h"
 #include "Buttons.h"
+#include "BlueprintLibrary.h"
+#include "Logger.h"
 
 class Group;
 class Graph;
@@ -17,20 +19,6 @@ extern Blueprint g_clipboardBP;
 
 void DrawTextShadowedIV(const std::string& text, IVec2 pos, int fontSize, Color color, Color shadow);
 
-enum class LogType
-{
-    // Just FYI
-    info = 0,
-    // Upcoming might not be successful
-    attempt = 1,
-    // Successful
-    success = 2,
-    // Unsuccessful, can still continue
-    warning = 3,
-    // Cannot continue
-    error = 4,
-};
-
 struct UIStyle
 {
     Color fontColor = UIColor(UIColorID::UI_COLOR_FOREGROUND);
@@ -152,6 +140,8 @@ struct Window
     Window();
     ~Window();
 
+    Logger logger{ "session.log" }; // First, so it's still around for anything logged while the rest is torn down
+
 private:
     Texture2D iconSheet16x;
     Texture2D iconSheet32x;
@@ -175,9 +165,14 @@ public:
     IVec2 cursorPosPrev = IVec2::Zero(); // For checking if there was movement
     bool b_cursorMoved = false;
 
-    uint8_t framesPerTick = 6; // Number of frames in a tick
-    uint8_t tickFrame = framesPerTick - 1; // Evaluate on 0
-    bool tickThisFrame;
+    int maxFPS = 0; // Frame cap while awake; 0 for the monitor's refresh rate
+    int ticksPerSecond = 10; // Simulation cap, independent of the frame rate
+    double nextTickTime = 0.0;
+    int ticksThisFrame = 0;
+    bool simulationSettled = false; // The last tick changed nothing, so the ones after it won't either
+    double lastActivityTime = 0.0;
+    bool waitingForEvents = false; // Asleep until the next input
+    bool compressFiles = false; // Save sessions and blueprints block-compressed; loading handles either
 
     Gate gatePick = Gate::OR;
     Gate lastGate = Gate::OR;
@@ -190,14 +185,22 @@ public:
     Wire* hoveredWire = nullptr;
     Group* hoveredGroup = nullptr;
 
+    BlueprintLibrary library; // Shared by every tab
     Blueprint* clipboard = nullptr;
 
     int propertyNumber; // For the "PushProperty" functions
     IRect propertiesPaneRec;
 
+    // The latest log events, formatted the first time they're drawn. Only touched from the main thread.
+    struct ConsoleLogLine
+    {
+        LogEvent event;
+        double previousTime = 0.0;
+        std::string text;
+    };
     double timeOfLastLog = 0.0;
-    LogType minLogLevel = LogType::info; // Allows user to surpress logs below this level
-    std::string consoleOutput[6];
+    ConsoleLogLine consoleOutput[6];
+    size_t consoleNext = 0; // Oldest line, and where the next one goes
     IRect consolePaneRec;
 
     IconButton modeButtons[4];
@@ -251,6 +254,10 @@ public:
     void ClearOverlayMode();
 
     void IncrementTick();
+    void ApplyFrameCap();
+    // Puts the window to sleep between inputs once nothing has happened for a moment and the simulation has settled.
+    // busy keeps it awake for work that finishes on its own, like a save.
+    void UpdateFramePacing(bool busy);
 
     void UpdateCursorPos();
 
@@ -267,6 +274,9 @@ public:
 
     void SaveBlueprint();
 
+    // Exports the hovered group, else the last selection rectangle, else the whole graph, as SVG
+    void ExportSVG();
+
     void DrawClipboardPreview() const;
     bool IsClipboardValid() const;
     void ClearClipboard();
@@ -274,6 +284,11 @@ public:
     void ClearSelection();
     void DestroySelection();
 
+    void Undo();
+    void Redo();
+    // Drops every node/wire pointer held outside the graph; needed after undo/redo
+    void ForgetGraphReferences();
+
     void CheckHotkeys();
 
     IVec2 GetCursorDelta() const;
@@ -309,7 +324,21 @@ public:
 
     void CleanConsolePane();
     void DrawConsoleOutput();
-    void Log(LogType type, const std::string& output);
+    // Nothing is built unless the type and category pass the log filters; the file is written from the logger's thread
+    template<typename... Args>
+    void Log(LogType type, LogCategory category, LogFormat format, Args&&... args)
+    {
+        if (logger.IsEnabled(type, category))
+            Log(LogEvent(logger.Now(), type, category, format, std::forward<Args>(args)...));
+    }
+    template<typename... Args>
+    void Log(LogType type, LogFormat format, Args&&... args)
+    {
+        Log(type, LogCategory::general, format, std::forward<Args>(args)...);
+    }
+    // Shows the event in the console and queues it for the file.
+    // Errors wait until they've been written, since they're usually followed by exiting.
+    void Log(LogEvent&& event);
     void ClearLog();
 
     void CleanPropertiesPane();
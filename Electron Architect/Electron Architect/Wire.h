@@ -18,7 +18,7 @@ ElbowConfig& operator--(ElbowConfig& ec);
 
 struct Wire
 {
-    Wire() : elbow(), elbowConfig(), start(), end() {}
+    Wire() : elbow(), elbowConfig(), start(), end(), recordIndex() {}
     Wire(Node* start, Node* end);
     Wire(Node* start, Node* end, ElbowConfig elbowConfig);
 
@@ -28,6 +28,7 @@ struct Wire
     ElbowConfig elbowConfig;
     Node* start;
     Node* end;
+    uint32_t recordIndex; // Slot in the owning graph's snapshot records
 
     bool GetState() const;
     static void Draw(IVec2 start, IVec2 joint, IVec2 end, Color color);